@@ -0,0 +1,551 @@
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../ExerciseI/matvec_io.h"
+using namespace std;
+
+// Benchmark driver for every variant of ExerciseI, ExerciseII, ExerciseIII and
+// CompLabel. It first compiles each variant from the sources of its directory
+// into a scratch directory (--build-dir), so the timings are always those of
+// the current code, then runs the builds over a sweep of problem sizes and
+// thread/rank counts, repeats every configuration, and reports the median and
+// p95 wall time of the whole process, the throughput and the speedup and
+// efficiency against the sequential variant of the same size. A run that
+// fails or does not print its result is skipped, not timed.
+//
+// Throughput is GFLOP/s: 2*rows*cols*nvec for the matrix-vector product,
+// 12 per interior cell and sweep for the hot plate (update plus convergence
+// check; the sweep count is taken from the program's own "Iteraciones" line),
+// and n^2 + 2n^3 for ExerciseIII (addition plus multiplication). CompLabel
+// only has its built-in 4x5 image, so it is reported in Mpixel/s.
+
+struct Result {
+    string exercise, variant;
+    int size;
+    int workers;
+    int repeats;
+    double median, p95, min;
+    double throughput;
+    string unit;
+    double speedup, efficiency;  // 0 when there is no sequential baseline
+};
+
+struct Options {
+    vector<string> exercises, variants;
+    vector<int> threads, ranks;
+    vector<int> matvec_sizes, hotplate_sizes, matop_sizes;
+    int nvec, repeat, warmup;
+    int hybrid_threads;  // OpenMP threads per rank of the hybrid variant
+    int timeout;  // seconds per run
+    vector<string> mpirun;
+    string root;
+    string build_dir;
+    string cxx, mpicxx;
+    vector<string> cxxflags;
+};
+
+// Source of each variant and the flags it needs besides --cxxflags. The mpi
+// and hybrid variants are compiled with --mpicxx, the rest with --cxx.
+struct VariantSource {
+    const char *exercise, *variant, *source, *flags;
+};
+
+const VariantSource VARIANT_SOURCES[] = {
+    {"I", "seq", "sequential_mult.cpp", ""},
+    {"I", "pthr", "pthreads_mult.cpp", "-pthread"},
+    {"I", "omp", "openmp_mult.cpp", "-fopenmp"},
+    {"I", "mpi", "openmpi_mult.cpp", ""},
+    {"II", "seq", "hotplate_sequential.cpp", ""},
+    {"II", "pthr", "hotplate_pthreads.cpp", "-pthread"},
+    {"II", "omp", "hotplate_openmp.cpp", "-fopenmp"},
+    {"II", "mpi", "hotplate_mpi.cpp", ""},
+    {"II", "hybrid", "hotplate_hybrid.cpp", "-fopenmp"},
+    {"III", "seq", "matrix_op_sequential.cpp", ""},
+    {"III", "pthr", "matrix_op_pthreads.cpp", "-pthread"},
+    {"III", "omp", "matrix_op_openmp.cpp", "-fopenmp"},
+    {"III", "mpi", "matrix_op_openmpi.cpp", ""},
+    {"CompLabel", "seq", "component_label_seq.cpp", ""},
+    {"CompLabel", "pthr", "component_label_pthr.cpp", "-pthread"},
+    {"CompLabel", "omp", "component_label_omp.cpp", "-fopenmp"},
+    {"CompLabel", "mpi", "component_label_mpi.cpp", ""},
+};
+
+vector<string> split(const string &s, char sep) {
+    vector<string> parts;
+    string item;
+    istringstream in(s);
+    while (getline(in, item, sep)) {
+        if (!item.empty())
+            parts.push_back(item);
+    }
+    return parts;
+}
+
+vector<int> split_ints(const string &s) {
+    vector<int> values;
+    for (const string &item : split(s, ','))
+        values.push_back(atoi(item.c_str()));
+    return values;
+}
+
+// Runs args (args[0] is looked up in PATH or relative to dir) with dir as the
+// working directory and OMP_NUM_THREADS set to threads. stdout is captured in
+// out. Returns the wall time in seconds, or -1 if the program failed or ran
+// longer than timeout seconds (it is then killed).
+double run_timed(const string &dir, const vector<string> &args, int threads, int timeout, string &out) {
+    int fds[2];
+    if (pipe(fds) != 0)
+        return -1;
+    auto t_start = chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        setpgid(0, 0);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        if (chdir(dir.c_str()) != 0)
+            _exit(127);
+        setenv("OMP_NUM_THREADS", to_string(threads).c_str(), 1);
+        vector<char*> cargs;
+        for (const string &a : args)
+            cargs.push_back((char*) a.c_str());
+        cargs.push_back(nullptr);
+        execvp(cargs[0], cargs.data());
+        _exit(127);
+    }
+    close(fds[1]);
+    if (pid < 0) {
+        close(fds[0]);
+        return -1;
+    }
+    setpgid(pid, pid);
+    // Drain the pipe while the program runs so large outputs cannot block it.
+    out.clear();
+    char buf[65536];
+    bool timed_out = false;
+    auto deadline = t_start + chrono::seconds(timeout);
+    while (true) {
+        int left = (int) chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+        struct pollfd pfd = {fds[0], POLLIN, 0};
+        if (left <= 0 || poll(&pfd, 1, left) == 0) {
+            timed_out = true;
+            break;
+        }
+        ssize_t n = read(fds[0], buf, sizeof(buf));
+        if (n <= 0)
+            break;
+        out.append(buf, n);
+    }
+    close(fds[0]);
+    int status;
+    if (timed_out) {
+        // mpirun puts the ranks in their own process groups but takes them
+        // down on SIGTERM; SIGKILL only if that does not finish it in time.
+        kill(-pid, SIGTERM);
+        for (int i = 0; i < 50 && waitpid(pid, &status, WNOHANG) == 0; i++)
+            usleep(100000);
+        kill(-pid, SIGKILL);
+    }
+    waitpid(pid, &status, 0);
+    auto t_end = chrono::steady_clock::now();
+    if (timed_out || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return -1;
+    return chrono::duration<double>(t_end - t_start).count();
+}
+
+// Random int32 input files for ExerciseI, same value ranges as aio_generator.
+bool write_matvec_input(const string &dir, int n, int nvec) {
+    string matrix_path = dir + "/bench_matrix.bin", vec_path = dir + "/bench_vector.bin";
+    FILE *mf = fopen(matrix_path.c_str(), "wb");
+    FILE *vf = fopen(vec_path.c_str(), "wb");
+    bool ok = mf && vf && write_matrix_header(mf, DTYPE_INT32, n, n)
+                       && write_matrix_header(vf, DTYPE_INT32, nvec, n);
+    vector<int32_t> row(n);
+    for (int i = 0; ok && i < n + nvec; i++) {
+        for (int j = 0; j < n; j++)
+            row[j] = i < n ? rand() % 100 : rand() % 10;
+        ok = fwrite(row.data(), sizeof(int32_t), n, i < n ? mf : vf) == (size_t) n;
+    }
+    if (mf && fclose(mf) != 0)
+        ok = false;
+    if (vf && fclose(vf) != 0)
+        ok = false;
+    return ok;
+}
+
+// Command line of one run. ExerciseIII takes its two n x n matrices in argv.
+vector<string> command_line(const Options &opt, const string &exercise, const string &variant,
+                            int n, int workers, const vector<string> &matop_values) {
+    vector<string> args;
+    if (variant == "mpi" || variant == "hybrid") {
+        args = opt.mpirun;
+        args.push_back("-n");
+        args.push_back(to_string(workers));
+    }
+    args.push_back("./run_" + variant);
+    if (exercise == "CompLabel")
+        return args;
+    if (exercise == "I") {
+        if (variant == "pthr" || variant == "omp") {
+            args.push_back("--threads");
+            args.push_back(to_string(workers));
+        }
+        args.push_back("--bin");
+        args.push_back("bench_matrix.bin");
+        args.push_back("bench_vector.bin");
+    } else if (exercise == "II") {
+        args.push_back(to_string(n));
+        args.push_back(to_string(n));
+        if (variant == "pthr" || variant == "omp")
+            args.push_back(to_string(workers));
+        else if (variant == "hybrid")
+            args.push_back(to_string(opt.hybrid_threads));
+    } else {
+        for (int k = 0; k < 4; k++)
+            args.push_back(to_string(n));
+        args.insert(args.end(), matop_values.begin(), matop_values.end());
+    }
+    return args;
+}
+
+// Worker counts to sweep for a variant: threads, or ranks for mpi and hybrid
+// (each hybrid rank runs --hybrid-threads threads). Variants whose thread
+// count is fixed in the source (ExerciseIII pthreads: one thread per
+// operation, CompLabel pthreads: 4) run once with that count; ExerciseIII MPI
+// needs 3+ ranks.
+vector<int> worker_counts(const Options &opt, const string &exercise, const string &variant) {
+    if (variant == "seq")
+        return {1};
+    if (variant == "mpi" && exercise == "III") {
+        vector<int> ranks;
+        for (int r : opt.ranks) {
+            if (r >= 3)
+                ranks.push_back(r);
+        }
+        return ranks.empty() ? vector<int>{3} : ranks;
+    }
+    if (variant == "mpi" || variant == "hybrid")
+        return opt.ranks;
+    if (variant == "pthr" && exercise == "III")
+        return {3};
+    if (variant == "pthr" && exercise == "CompLabel")
+        return {4};
+    return opt.threads;
+}
+
+// Work done by one run, in the unit of the exercise (see the top comment).
+double work_of(const string &exercise, const string &variant, int n, int nvec,
+               const string &out, string &unit) {
+    unit = "GFLOP/s";
+    if (exercise == "I")
+        return 2.0 * n * n * nvec / 1e9;
+    if (exercise == "II") {
+        size_t pos = out.find("Iteraciones: ");
+        if (pos == string::npos)
+            return 0;
+        double iterations = atof(out.c_str() + pos + strlen("Iteraciones: "));
+        // The sequential version counts sweeps, the others count pairs of sweeps.
+        double sweeps = variant == "seq" ? iterations : 2 * iterations;
+        return 12.0 * (n - 2) * (n - 2) * sweeps / 1e9;
+    }
+    if (exercise == "III")
+        return ((double) n * n + 2.0 * n * n * n) / 1e9;
+    unit = "Mpixel/s";
+    return 4 * 5 / 1e6;
+}
+
+// Whether out holds the result of the run, so a program that exits 0 without
+// doing the work (an old build that ignores an option, a usage message) is
+// not timed: nvec results of n values for ExerciseI, the iteration count for
+// ExerciseII, the transpose (printed last) for ExerciseIII and the labels for
+// CompLabel.
+bool valid_output(const string &exercise, int n, int nvec, const string &out) {
+    if (exercise == "I") {
+        size_t pos = 0;
+        for (int k = 0; k < nvec; k++) {
+            pos = out.find("Result", pos);
+            size_t open = out.find('{', pos);
+            size_t close = out.find('}', open);
+            if (pos == string::npos || open == string::npos || close == string::npos)
+                return false;
+            if (out.substr(pos, open - pos).find("(size " + to_string(n) + ")") == string::npos)
+                return false;
+            istringstream values(out.substr(open + 1, close - open - 1));
+            string value;
+            int count = 0;
+            while (values >> value)
+                count++;
+            if (count != n)
+                return false;
+            pos = close;
+        }
+        return true;
+    }
+    if (exercise == "II")
+        return out.find("Iteraciones: ") != string::npos;
+    if (exercise == "III")
+        return out.find("Transpose of Matrix") != string::npos;
+    return !out.empty();
+}
+
+// Compiles src into build_dir/run_<variant>. The compiler's messages go to
+// stderr; returns false if it fails.
+bool build_variant(const Options &opt, const VariantSource &v, const string &src, const string &build_dir) {
+    bool mpi = strcmp(v.variant, "mpi") == 0 || strcmp(v.variant, "hybrid") == 0;
+    vector<string> args = split(mpi ? opt.mpicxx : opt.cxx, ' ');
+    args.insert(args.end(), opt.cxxflags.begin(), opt.cxxflags.end());
+    for (const string &flag : split(v.flags, ' '))
+        args.push_back(flag);
+    args.push_back("-o");
+    args.push_back(build_dir + "/run_" + v.variant);
+    args.push_back(src + "/" + v.source);
+    string out;
+    return run_timed(".", args, 1, opt.timeout, out) >= 0;
+}
+
+// Nearest-rank percentile of sorted samples.
+double percentile(const vector<double> &sorted, double p) {
+    size_t rank = (size_t) ceil(p * sorted.size());
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+void benchmark_exercise(const Options &opt, const string &exercise, vector<Result> &results) {
+    string name = exercise == "CompLabel" ? "CompLabel" : "Exercise" + exercise;
+    string src = opt.root + "/" + name, dir = opt.build_dir + "/" + name;
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        cerr << "Error: cannot create " << dir << endl;
+        return;
+    }
+    // Build the requested variants of this exercise; the runs use these builds.
+    vector<string> variants;
+    for (const string &variant : opt.variants) {
+        for (const VariantSource &v : VARIANT_SOURCES) {
+            if (exercise != v.exercise || variant != v.variant)
+                continue;
+            if (build_variant(opt, v, src, dir))
+                variants.push_back(variant);
+            else
+                cerr << "Warning: " << exercise << " " << variant << " does not build, skipped" << endl;
+        }
+    }
+    vector<int> sizes = exercise == "I"   ? opt.matvec_sizes
+                      : exercise == "II"  ? opt.hotplate_sizes
+                      : exercise == "III" ? opt.matop_sizes
+                                          : vector<int>{4};
+    for (int n : sizes) {
+        vector<string> matop_values;
+        if (exercise == "I" && !write_matvec_input(dir, n, opt.nvec)) {
+            cerr << "Error: cannot write the input files in " << dir << endl;
+            return;
+        }
+        if (exercise == "III") {
+            for (long k = 0; k < 2L * n * n; k++)
+                matop_values.push_back(to_string(rand() % 100));
+        }
+
+        for (const string &variant : variants) {
+            for (int workers : worker_counts(opt, exercise, variant)) {
+                vector<string> args = command_line(opt, exercise, variant, n, workers, matop_values);
+                int threads = variant == "mpi" ? 1 : variant == "hybrid" ? opt.hybrid_threads : workers;
+                vector<double> times;
+                string out;
+                bool failed = false;
+                for (int r = 0; r < opt.warmup + opt.repeat && !failed; r++) {
+                    double t = run_timed(dir, args, threads, opt.timeout, out);
+                    failed = t < 0 || !valid_output(exercise, n, opt.nvec, out);
+                    if (r >= opt.warmup)
+                        times.push_back(t);
+                }
+                if (failed) {
+                    cerr << "Warning: " << exercise << " " << variant << " n=" << n
+                         << " workers=" << workers << " failed, timed out or printed no result, skipped" << endl;
+                    continue;
+                }
+                sort(times.begin(), times.end());
+
+                Result res;
+                res.exercise = exercise;
+                res.variant = variant;
+                res.size = n;
+                res.workers = variant == "hybrid" ? workers * opt.hybrid_threads : workers;
+                res.repeats = opt.repeat;
+                res.median = times.size() % 2 ? times[times.size() / 2]
+                           : (times[times.size() / 2 - 1] + times[times.size() / 2]) / 2;
+                res.p95 = percentile(times, 0.95);
+                res.min = times[0];
+                res.throughput = work_of(exercise, variant, n, opt.nvec, out, res.unit) / res.median;
+                res.speedup = res.efficiency = 0;
+                results.push_back(res);
+                printf("%-9s %-6s %6d %4d  median %9.4fs  p95 %9.4fs  %10.3f %s\n",
+                       exercise.c_str(), variant.c_str(), n, res.workers, res.median, res.p95,
+                       res.throughput, res.unit.c_str());
+                fflush(stdout);
+            }
+        }
+        if (exercise == "I") {
+            unlink((dir + "/bench_matrix.bin").c_str());
+            unlink((dir + "/bench_vector.bin").c_str());
+        }
+    }
+}
+
+// Speedup and efficiency against the sequential median of the same problem.
+void compute_speedup(vector<Result> &results) {
+    map<pair<string, int>, double> baseline;
+    for (const Result &r : results) {
+        if (r.variant == "seq")
+            baseline[make_pair(r.exercise, r.size)] = r.median;
+    }
+    for (Result &r : results) {
+        auto it = baseline.find(make_pair(r.exercise, r.size));
+        if (it != baseline.end() && r.median > 0) {
+            r.speedup = it->second / r.median;
+            r.efficiency = r.speedup / r.workers;
+        }
+    }
+}
+
+bool write_csv(const string &path, const vector<Result> &results) {
+    ofstream f(path);
+    f << "exercise,variant,size,workers,repeats,median_s,p95_s,min_s,throughput,unit,speedup,efficiency\n";
+    for (const Result &r : results) {
+        f << r.exercise << "," << r.variant << "," << r.size << "," << r.workers << ","
+          << r.repeats << "," << r.median << "," << r.p95 << "," << r.min << ","
+          << r.throughput << "," << r.unit << "," << r.speedup << "," << r.efficiency << "\n";
+    }
+    return (bool) f;
+}
+
+bool write_json(const string &path, const vector<Result> &results) {
+    ofstream f(path);
+    f << "[\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+        f << "  {\"exercise\": \"" << r.exercise << "\", \"variant\": \"" << r.variant
+          << "\", \"size\": " << r.size << ", \"workers\": " << r.workers
+          << ", \"repeats\": " << r.repeats << ", \"median_s\": " << r.median
+          << ", \"p95_s\": " << r.p95 << ", \"min_s\": " << r.min
+          << ", \"throughput\": " << r.throughput << ", \"unit\": \"" << r.unit
+          << "\", \"speedup\": " << r.speedup << ", \"efficiency\": " << r.efficiency << "}"
+          << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    f << "]\n";
+    return (bool) f;
+}
+
+int main(int argc, char* argv[]){
+    const char *exercises_opt = take_option(argc, argv, "--exercises");
+    const char *variants_opt = take_option(argc, argv, "--variants");
+    const char *threads_opt = take_option(argc, argv, "--threads");
+    const char *ranks_opt = take_option(argc, argv, "--ranks");
+    const char *matvec_opt = take_option(argc, argv, "--matvec-sizes");
+    const char *hotplate_opt = take_option(argc, argv, "--hotplate-sizes");
+    const char *matop_opt = take_option(argc, argv, "--matop-sizes");
+    const char *nvec_opt = take_option(argc, argv, "--nvec");
+    const char *hybrid_threads_opt = take_option(argc, argv, "--hybrid-threads");
+    const char *repeat_opt = take_option(argc, argv, "--repeat");
+    const char *warmup_opt = take_option(argc, argv, "--warmup");
+    const char *timeout_opt = take_option(argc, argv, "--timeout");
+    const char *mpirun_opt = take_option(argc, argv, "--mpirun");
+    const char *root_opt = take_option(argc, argv, "--root");
+    const char *build_dir_opt = take_option(argc, argv, "--build-dir");
+    const char *cxx_opt = take_option(argc, argv, "--cxx");
+    const char *mpicxx_opt = take_option(argc, argv, "--mpicxx");
+    const char *cxxflags_opt = take_option(argc, argv, "--cxxflags");
+    const char *csv_opt = take_option(argc, argv, "--csv");
+    const char *json_opt = take_option(argc, argv, "--json");
+    if (argc > 1) {
+        cout << "Usage: " << argv[0] << " [options]" << endl
+             << "  --exercises I,II,III,CompLabel  --variants seq,pthr,omp,mpi,hybrid" << endl
+             << "  --threads 1,2,4  --ranks 1,2,4 (default: powers of two up to the core count)" << endl
+             << "  --hybrid-threads <n> (2)  --matvec-sizes 1024,2048,4096  --hotplate-sizes 1024" << endl
+             << "  --matop-sizes 64,128,256  --nvec <n>  --repeat <n> (5)  --warmup <n> (1)  --timeout <s> (600)" << endl
+             << "  --mpirun \"mpirun --oversubscribe\"  --root <src dir> (..)  --build-dir <dir> (bench_build)" << endl
+             << "  --cxx <compiler> (g++)  --mpicxx <compiler> (mpicxx)  --cxxflags \"<flags>\" (-O2)" << endl
+             << "  --csv <file>  --json <file>" << endl;
+        return 1;
+    }
+
+    vector<int> counts;
+    int ncores = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    for (int t = 1; t < ncores; t *= 2)
+        counts.push_back(t);
+    counts.push_back(ncores);
+
+    Options opt;
+    opt.exercises = split(exercises_opt ? exercises_opt : "I,II,III,CompLabel", ',');
+    opt.variants = split(variants_opt ? variants_opt : "seq,pthr,omp,mpi,hybrid", ',');
+    opt.threads = threads_opt ? split_ints(threads_opt) : counts;
+    opt.ranks = ranks_opt ? split_ints(ranks_opt) : counts;
+    opt.matvec_sizes = split_ints(matvec_opt ? matvec_opt : "1024,2048,4096");
+    opt.hotplate_sizes = split_ints(hotplate_opt ? hotplate_opt : "1024");
+    opt.matop_sizes = split_ints(matop_opt ? matop_opt : "64,128,256");
+    opt.nvec = nvec_opt ? atoi(nvec_opt) : 1;
+    opt.hybrid_threads = hybrid_threads_opt ? max(1, atoi(hybrid_threads_opt)) : 2;
+    opt.repeat = repeat_opt ? max(1, atoi(repeat_opt)) : 5;
+    opt.warmup = warmup_opt ? max(0, atoi(warmup_opt)) : 1;
+    opt.timeout = timeout_opt ? max(1, atoi(timeout_opt)) : 600;
+    opt.mpirun = split(mpirun_opt ? mpirun_opt : "mpirun", ' ');
+    opt.root = root_opt ? root_opt : "..";
+    opt.build_dir = build_dir_opt ? build_dir_opt : "bench_build";
+    opt.cxx = cxx_opt ? cxx_opt : "g++";
+    opt.mpicxx = mpicxx_opt ? mpicxx_opt : "mpicxx";
+    opt.cxxflags = split(cxxflags_opt ? cxxflags_opt : "-O2", ' ');
+    if (mkdir(opt.build_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        cerr << "Error: cannot create " << opt.build_dir << endl;
+        return 1;
+    }
+
+    // Same inputs on every invocation, so runs of different builds compare.
+    srand(12345);
+    for (const string &variant : opt.variants) {
+        if (variant != "seq" && variant != "pthr" && variant != "omp" && variant != "mpi" && variant != "hybrid") {
+            cerr << "Error: unknown variant " << variant << endl;
+            return 1;
+        }
+    }
+    vector<Result> results;
+    for (const string &exercise : opt.exercises) {
+        if (exercise != "I" && exercise != "II" && exercise != "III" && exercise != "CompLabel") {
+            cerr << "Error: unknown exercise " << exercise << endl;
+            return 1;
+        }
+        benchmark_exercise(opt, exercise, results);
+    }
+    compute_speedup(results);
+
+    cout << endl;
+    printf("%-9s %-6s %6s %4s %10s %10s %12s %-8s %8s %6s\n", "exercise", "var", "size", "wkrs",
+           "median_s", "p95_s", "throughput", "unit", "speedup", "eff");
+    for (const Result &r : results) {
+        printf("%-9s %-6s %6d %4d %10.4f %10.4f %12.3f %-8s %8.2f %6.2f\n",
+               r.exercise.c_str(), r.variant.c_str(), r.size, r.workers, r.median, r.p95,
+               r.throughput, r.unit.c_str(), r.speedup, r.efficiency);
+    }
+
+    if (csv_opt && !write_csv(csv_opt, results)) {
+        cerr << "Error: cannot write " << csv_opt << endl;
+        return 1;
+    }
+    if (json_opt && !write_json(json_opt, results)) {
+        cerr << "Error: cannot write " << json_opt << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -1,18 +1,68 @@
 #include <iostream>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
 #include <sstream>
+#include <vector>
+#include "matvec_io.h"
 using namespace std;
 
+// Matrices larger than this are only written to the input files, not echoed.
+const long PRINT_LIMIT = 4096;
+
+// Writes a rows x cols block of random values below `range` as elements of T,
+// echoing them when print is set.
+template <typename T>
+void write_random(FILE *f, int rows, int cols, int range, bool print) {
+	vector<T> row(cols);
+	for (int i = 0; i < rows; i++) {
+		for (int j = 0; j < cols; j++) {
+			int num = rand() % range;
+			// Float types get a fractional part so rounding is exercised too.
+			row[j] = (T(0.5) != 0) ? (T) num + (T) (rand() % 4) / 4 : (T) num;
+			if (print)
+				cout << row[j] << " ";
+		}
+		fwrite(row.data(), sizeof(T), cols, f);
+		if (print)
+			cout << endl;
+	}
+}
+
+template <typename T>
+void write_inputs(FILE *mf, FILE *vf, int rows, int cols, int nvec, bool print) {
+	cout << "Matrix (" << rows << "x" << cols << "):" << endl;
+	write_random<T>(mf, rows, cols, 100, print); // Random number between 0-99
+	cout << endl;
+
+	for (int k = 0; k < nvec; k++) {
+		cout << "Vector (" << cols << "):" << endl;
+		write_random<T>(vf, 1, cols, 10, print);
+		cout << endl << endl;
+	}
+}
+
 int main(int argc, char* argv[]){
+	if (argc < 5) {
+		cerr << "Usage: " << argv[0] << " <rows> <cols> <seq|pthr|omp|mpi> <nthreads> [nvec] [int32|int64|float32|float64]" << endl;
+		return 1;
+	}
 	srand(time(0));
 	int rows = atoi(argv[1]);
 	int cols = atoi(argv[2]);
 	const char *funct_to_run = argv[3];
 	int nthreads = atoi(argv[4]);
+	int nvec = argc > 5 ? atoi(argv[5]) : 1; // right-hand sides multiplied as one batch
+	uint32_t dtype = argc > 6 ? dtype_from_name(argv[6]) : (uint32_t) DTYPE_INT32;
+	if (dtype == 0) {
+		cerr << "Error: unknown element type " << argv[6] << endl;
+		return 1;
+	}
+	const char *matrix_path = "matrix.bin";
+	const char *vec_path = "vector.bin";
+	bool print = (long) rows * cols <= PRINT_LIMIT;
 	string run;
-	int num;
 
 	ostringstream cmd;
 
@@ -26,31 +76,33 @@ int main(int argc, char* argv[]){
 		run = "./run_mpi";
 	}
 
-	if (strcmp(funct_to_run, "mpi") != 0) {
-		cmd << run << " " << rows << " " << cols << " ";
+	if (strcmp(funct_to_run, "pthr") == 0 || strcmp(funct_to_run, "omp") == 0) {
+		cmd << run << " --threads " << nthreads << " --bin " << matrix_path << " " << vec_path;
+	} else if (strcmp(funct_to_run, "mpi") != 0) {
+		cmd << run << " --bin " << matrix_path << " " << vec_path;
 	} else {
-		cmd << "mpirun -n " << nthreads << " " << rows << " " << cols << " ";
+		cmd << "mpirun -n " << nthreads << " " << run << " --bin " << matrix_path << " " << vec_path;
 	}
 
-	int i, j;
-	cout << "Matrix (" << rows << "x" << cols << "):" << endl;
-	for (i = 0; i < rows; i++) {
-		for (j = 0; j < cols; j++) {
-			num = rand() % 100; // Random number between 0-99
-			cmd << num << " ";
-			cout << num << " ";
-        	}
-		cout << endl;
+	FILE *mf = fopen(matrix_path, "wb");
+	FILE *vf = fopen(vec_path, "wb");
+	if (!mf || !vf || !write_matrix_header(mf, dtype, rows, cols)
+	               || !write_matrix_header(vf, dtype, nvec, cols)) {
+		cerr << "Error: cannot write " << matrix_path << " / " << vec_path << endl;
+		return 1;
+	}
+
+	switch (dtype) {
+		case DTYPE_INT64:   write_inputs<int64_t>(mf, vf, rows, cols, nvec, print); break;
+		case DTYPE_FLOAT32: write_inputs<float>(mf, vf, rows, cols, nvec, print); break;
+		case DTYPE_FLOAT64: write_inputs<double>(mf, vf, rows, cols, nvec, print); break;
+		default:            write_inputs<int32_t>(mf, vf, rows, cols, nvec, print); break;
 	}
-	cout << endl;
 
-	cout << "Vector (" << cols << "):" << endl;
-	for (i = 0; i < cols; i++) {
-		num = rand() % 10;
-		cmd << num << " ";
-		cout << num << " ";
+	if (fclose(mf) != 0 || fclose(vf) != 0) {
+		cerr << "Error: cannot write " << matrix_path << " / " << vec_path << endl;
+		return 1;
 	}
-	cout << endl << endl;
 
 	string command = cmd.str();
 	system(command.c_str());
@@ -0,0 +1,391 @@
+#ifndef MATVEC_IO_H
+#define MATVEC_IO_H
+
+// Shared input handling for the ExerciseI matrix-vector programs.
+//
+// Besides the original "<rows> <cols> <values>..." command line, every variant
+// accepts "--bin <matrix file> <vector file>". Both files use the layout below:
+// a 64-byte header followed by the raw row-major payload. The vector file is a
+// K x cols matrix holding K right-hand sides, which are multiplied as one batch
+// (K = 1 is the plain matrix-vector product). Files are mmap'ed, so there is
+// no per-element parsing and the payload starts 64-byte aligned (the mapping
+// itself is page aligned).
+//
+// The element type comes from the header (int32, int64, float32 or float64)
+// and must match between the two files; each program then runs the kernel
+// instantiated for that type. Argv input is always int32.
+
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "matvec_kernel.h"
+
+enum MatrixDtype : uint32_t {
+    DTYPE_INT32   = 1,
+    DTYPE_INT64   = 2,
+    DTYPE_FLOAT32 = 3,
+    DTYPE_FLOAT64 = 4
+};
+
+static const char MATRIX_FILE_MAGIC[8] = {'M', 'A', 'T', 'V', 'E', 'C', '0', '1'};
+
+struct MatrixFileHeader {
+    char magic[8];      // MATRIX_FILE_MAGIC
+    uint32_t dtype;     // MatrixDtype
+    uint32_t elem_size; // bytes per element, redundant with dtype but checked
+    uint64_t rows;
+    uint64_t cols;
+    uint8_t reserved[32];
+};
+static_assert(sizeof(MatrixFileHeader) == 64, "matrix file header must stay 64 bytes");
+
+inline uint32_t dtype_size(uint32_t dtype) {
+    switch (dtype) {
+        case DTYPE_INT32:   return 4;
+        case DTYPE_INT64:   return 8;
+        case DTYPE_FLOAT32: return 4;
+        case DTYPE_FLOAT64: return 8;
+        default:            return 0;
+    }
+}
+
+inline const char* dtype_name(uint32_t dtype) {
+    switch (dtype) {
+        case DTYPE_INT32:   return "int32";
+        case DTYPE_INT64:   return "int64";
+        case DTYPE_FLOAT32: return "float32";
+        case DTYPE_FLOAT64: return "float64";
+        default:            return "unknown";
+    }
+}
+
+// Inverse of dtype_name(); returns 0 for an unknown name.
+inline uint32_t dtype_from_name(const char *name) {
+    for (uint32_t d = DTYPE_INT32; d <= DTYPE_FLOAT64; d++) {
+        if (strcmp(name, dtype_name(d)) == 0)
+            return d;
+    }
+    return 0;
+}
+
+// Element type of each dtype, for the writers.
+template <typename T> struct DtypeOf;
+template <> struct DtypeOf<int32_t> { static const uint32_t value = DTYPE_INT32; };
+template <> struct DtypeOf<int64_t> { static const uint32_t value = DTYPE_INT64; };
+template <> struct DtypeOf<float>   { static const uint32_t value = DTYPE_FLOAT32; };
+template <> struct DtypeOf<double>  { static const uint32_t value = DTYPE_FLOAT64; };
+
+// Writes the header of a matrix file; the caller then fwrite()s rows*cols
+// elements in row-major order.
+inline bool write_matrix_header(FILE *f, uint32_t dtype, uint64_t rows, uint64_t cols) {
+    MatrixFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MATRIX_FILE_MAGIC, sizeof(h.magic));
+    h.dtype = dtype;
+    h.elem_size = dtype_size(dtype);
+    h.rows = rows;
+    h.cols = cols;
+    return fwrite(&h, sizeof(h), 1, f) == 1;
+}
+
+// Read-only mapping of a matrix file. The header is validated on open().
+class MatrixFile {
+public:
+    MatrixFile() : base(nullptr), length(0) {}
+    ~MatrixFile() { close(); }
+    MatrixFile(const MatrixFile&) = delete;
+    MatrixFile& operator=(const MatrixFile&) = delete;
+
+    bool open(const char *path) {
+        close();
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            std::cerr << "Error: cannot open " << path << std::endl;
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(MatrixFileHeader)) {
+            std::cerr << "Error: " << path << " is not a matrix file" << std::endl;
+            ::close(fd);
+            return false;
+        }
+        length = st.st_size;
+        base = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED) {
+            std::cerr << "Error: cannot map " << path << std::endl;
+            base = nullptr;
+            return false;
+        }
+
+        const MatrixFileHeader *h = header();
+        uint32_t esize = dtype_size(h->dtype);
+        if (memcmp(h->magic, MATRIX_FILE_MAGIC, sizeof(h->magic)) != 0 ||
+            esize == 0 || esize != h->elem_size) {
+            std::cerr << "Error: " << path << " has an invalid header" << std::endl;
+            close();
+            return false;
+        }
+        if (h->cols != 0 && h->rows > (length - sizeof(MatrixFileHeader)) / esize / h->cols) {
+            std::cerr << "Error: " << path << " is truncated" << std::endl;
+            close();
+            return false;
+        }
+        // The payload is normally streamed front to back exactly once.
+        madvise(base, length, MADV_SEQUENTIAL);
+        return true;
+    }
+
+    void close() {
+        if (base)
+            munmap(base, length);
+        base = nullptr;
+        length = 0;
+    }
+
+    const MatrixFileHeader* header() const { return (const MatrixFileHeader*) base; }
+    uint64_t rows() const { return header()->rows; }
+    uint64_t cols() const { return header()->cols; }
+    uint32_t dtype() const { return header()->dtype; }
+    const void* data() const { return (const char*) base + sizeof(MatrixFileHeader); }
+
+private:
+    void *base;
+    size_t length;
+};
+
+// Matrix and vector for one run, either mapped from files or parsed from argv.
+// Both buffers hold elements of `dtype`; programs cast them to the matching T.
+struct MatvecInput {
+    int rows = 0;
+    int cols = 0;
+    uint32_t dtype = DTYPE_INT32;
+    const void *matrix = nullptr; // rows x cols, row-major
+    int nvec = 1;
+    const void *vec = nullptr;    // nvec x cols, one vector per row
+
+    MatrixFile matrix_file, vec_file;
+    AlignedArray<int32_t> argv_matrix, argv_vec;
+};
+
+// Checks that a matrix file and a vector file can be multiplied together. The
+// programs index with int, so every size must fit in one.
+inline bool check_input_files(const MatrixFile &matrix_file, const MatrixFile &vec_file) {
+    if (matrix_file.rows() < 1 || matrix_file.rows() > INT_MAX ||
+        matrix_file.cols() < 1 || matrix_file.cols() > INT_MAX) {
+        std::cerr << "Error: matrix must have 1 to " << INT_MAX << " rows and columns" << std::endl;
+        return false;
+    }
+    if (vec_file.rows() > INT_MAX) {
+        std::cerr << "Error: vector file holds more than " << INT_MAX << " vectors" << std::endl;
+        return false;
+    }
+    if (matrix_file.dtype() != vec_file.dtype()) {
+        std::cerr << "Error: matrix is " << dtype_name(matrix_file.dtype())
+                  << " but vector is " << dtype_name(vec_file.dtype()) << std::endl;
+        return false;
+    }
+    if (vec_file.rows() < 1 || vec_file.cols() != matrix_file.cols()) {
+        std::cerr << "Error: vector file must be K x " << matrix_file.cols() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+inline bool load_binary_input(const char *matrix_path, const char *vec_path, MatvecInput &in) {
+    if (!in.matrix_file.open(matrix_path) || !in.vec_file.open(vec_path))
+        return false;
+    if (!check_input_files(in.matrix_file, in.vec_file))
+        return false;
+    in.rows = (int) in.matrix_file.rows();
+    in.cols = (int) in.matrix_file.cols();
+    in.dtype = in.matrix_file.dtype();
+    in.nvec = (int) in.vec_file.rows();
+    in.matrix = in.matrix_file.data();
+    in.vec = in.vec_file.data();
+    return true;
+}
+
+// Checks the <rows> <cols> of an argv input.
+inline bool check_argv_sizes(int rows, int cols) {
+    if (rows < 1 || cols < 1) {
+        std::cerr << "Error: <rows> and <cols> must be at least 1" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+inline bool load_argv_input(int argc, char* argv[], MatvecInput &in) {
+    in.rows = atoi(argv[1]);
+    in.cols = atoi(argv[2]);
+    in.dtype = DTYPE_INT32;
+    if (!check_argv_sizes(in.rows, in.cols))
+        return false;
+    size_t count = (size_t) in.rows * in.cols;
+    if ((size_t) argc < 3 + count + in.cols) {
+        std::cerr << "Error: expected " << count + in.cols << " values after <rows> <cols>" << std::endl;
+        return false;
+    }
+    int arg_index = 3;
+    in.argv_matrix.allocate(count);
+    for (size_t i = 0; i < count; i++)
+        in.argv_matrix[i] = atoi(argv[arg_index++]);
+    in.argv_vec.allocate(in.cols);
+    for (int j = 0; j < in.cols; j++)
+        in.argv_vec[j] = atoi(argv[arg_index++]);
+    in.matrix = in.argv_matrix.data();
+    in.vec = in.argv_vec.data();
+    return true;
+}
+
+// Removes "<name> <value>" from argv, wherever it appears, and returns the
+// value, or nullptr when the option is absent. Programs call this for their
+// own flags before load_input() sees the remaining arguments.
+inline const char* take_option(int &argc, char* argv[], const char *name) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], name) == 0) {
+            const char *value = argv[i + 1];
+            for (int k = i; k + 2 <= argc; k++)
+                argv[k] = argv[k + 2];
+            argc -= 2;
+            return value;
+        }
+    }
+    return nullptr;
+}
+
+// Picks the input mode from the command line. Prints the usage line and
+// returns false when the arguments do not describe a valid input.
+inline bool load_input(int argc, char* argv[], MatvecInput &in) {
+    if (argc >= 4 && strcmp(argv[1], "--bin") == 0)
+        return load_binary_input(argv[2], argv[3], in);
+    if (argc >= 4)
+        return load_argv_input(argc, argv, in);
+    std::cout << "Usage: " << argv[0] << " <rows> <cols> <matrix values>... <vector values>..." << std::endl
+              << "       " << argv[0] << " --bin <matrix file> <vector file>" << std::endl
+              << "       " << argv[0] << " --mtx <matrix.mtx> <vector file> [--format csr|sell]" << std::endl;
+    return false;
+}
+
+// Splits n items into `parts` contiguous blocks, the first n % parts of them
+// one item larger, and returns the extent of block `index`.
+inline void block_range(int n, int parts, int index, int &begin, int &count) {
+    int base = n / parts, extra = n % parts;
+    count = base + (index < extra ? 1 : 0);
+    begin = index * base + (index < extra ? index : extra);
+}
+
+// The part of the input owned by one process of a 2D grid: a block of the
+// matrix and the matching column slice of every vector. Unlike MatvecInput,
+// only the block itself is ever copied into memory. The blocks are raw bytes
+// of `dtype`; use block_data<T>() to view them.
+struct MatvecBlock {
+    int rows = 0, cols = 0, nvec = 1;   // global sizes
+    uint32_t dtype = DTYPE_INT32;
+    AlignedArray<char> matrix;          // row_count x col_count elements
+    AlignedArray<char> vec;             // nvec x col_count elements
+
+    bool binary = false;
+    MatrixFile matrix_file, vec_file;
+    int argc = 0;
+    char **argv = nullptr;
+};
+
+// Reads only the global sizes, from the file headers or from argv. Nothing is
+// parsed or copied yet.
+inline bool open_input_block(int argc, char* argv[], MatvecBlock &blk) {
+    if (argc >= 4 && strcmp(argv[1], "--bin") == 0) {
+        if (!blk.matrix_file.open(argv[2]) || !blk.vec_file.open(argv[3]))
+            return false;
+        if (!check_input_files(blk.matrix_file, blk.vec_file))
+            return false;
+        blk.binary = true;
+        blk.rows = (int) blk.matrix_file.rows();
+        blk.cols = (int) blk.matrix_file.cols();
+        blk.dtype = blk.matrix_file.dtype();
+        blk.nvec = (int) blk.vec_file.rows();
+        return true;
+    }
+    if (argc >= 4) {
+        blk.binary = false;
+        blk.dtype = DTYPE_INT32;
+        blk.rows = atoi(argv[1]);
+        blk.cols = atoi(argv[2]);
+        blk.nvec = 1;
+        if (!check_argv_sizes(blk.rows, blk.cols))
+            return false;
+        size_t count = (size_t) blk.rows * blk.cols;
+        if ((size_t) argc < 3 + count + blk.cols) {
+            std::cerr << "Error: expected " << count + blk.cols << " values after <rows> <cols>" << std::endl;
+            return false;
+        }
+        blk.argc = argc;
+        blk.argv = argv;
+        return true;
+    }
+    std::cout << "Usage: " << argv[0] << " <rows> <cols> <matrix values>... <vector values>..." << std::endl
+              << "       " << argv[0] << " --bin <matrix file> <vector file>" << std::endl
+              << "       " << argv[0] << " --mtx <matrix.mtx> <vector file> [--format csr|sell]" << std::endl;
+    return false;
+}
+
+template <typename T>
+inline T* block_data(AlignedArray<char> &a) { return (T*) a.data(); }
+
+// Copies rows [row_begin, row_begin+row_count) x cols [col_begin, col_begin+col_count)
+// of the matrix into blk.matrix.
+inline void read_matrix_block(MatvecBlock &blk, int row_begin, int row_count,
+                              int col_begin, int col_count) {
+    size_t esize = dtype_size(blk.dtype);
+    blk.matrix.allocate((size_t) row_count * col_count * esize);
+    for (int i = 0; i < row_count; i++) {
+        size_t src = (size_t)(row_begin + i) * blk.cols + col_begin;
+        char *dst = blk.matrix.data() + (size_t) i * col_count * esize;
+        if (blk.binary) {
+            memcpy(dst, (const char*) blk.matrix_file.data() + src * esize, col_count * esize);
+        } else {
+            for (int j = 0; j < col_count; j++)
+                ((int32_t*) dst)[j] = atoi(blk.argv[3 + src + j]);
+        }
+    }
+}
+
+// Copies columns [col_begin, col_begin+col_count) of every vector into blk.vec.
+inline void read_vector_block(MatvecBlock &blk, int col_begin, int col_count) {
+    size_t esize = dtype_size(blk.dtype);
+    blk.vec.allocate((size_t) blk.nvec * col_count * esize);
+    size_t vec_start = 3 + (size_t) blk.rows * blk.cols;
+    for (int k = 0; k < blk.nvec; k++) {
+        size_t src = (size_t) k * blk.cols + col_begin;
+        char *dst = blk.vec.data() + (size_t) k * col_count * esize;
+        if (blk.binary) {
+            memcpy(dst, (const char*) blk.vec_file.data() + src * esize, col_count * esize);
+        } else {
+            for (int j = 0; j < col_count; j++)
+                ((int32_t*) dst)[j] = atoi(blk.argv[vec_start + src + j]);
+        }
+    }
+}
+
+// Prints the rows x nvec result Y, one block per right-hand side.
+template <typename Acc>
+inline void print_result(const Acc *Y, int rows, int nvec) {
+    for (int k = 0; k < nvec; k++) {
+        if (nvec > 1)
+            std::cout << "Result " << k << " (size " << rows << "):" << std::endl << "{ ";
+        else
+            std::cout << "Result (size " << rows << "):" << std::endl << "{ ";
+        for (int i = 0; i < rows; i++)
+            std::cout << Y[(size_t)i * nvec + k] << " ";
+        std::cout << "}" << std::endl;
+    }
+}
+
+#endif
@@ -0,0 +1,491 @@
+#ifndef MATVEC_KERNEL_H
+#define MATVEC_KERNEL_H
+
+// Matrix-vector kernels shared by the ExerciseI programs.
+//
+// The matrix is one contiguous row-major buffer. matvec_rows() computes
+// y[i] = A[i][:] . x for a range of rows and matmat_rows() does the same for
+// a batch of vectors, both with the widest kernel the CPU supports (AVX-512,
+// AVX2 or scalar), chosen once at runtime.
+//
+// The kernels are templates over the element type T and accumulate in
+// Accumulator<T>::type: int32 products are summed in int64 so large rows
+// cannot overflow, int64/float/double accumulate in their own type.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <immintrin.h>
+
+const size_t MATVEC_ALIGNMENT = 64;
+
+// Owning, 64-byte aligned array. The memory is left uninitialized so the
+// first write decides where its pages live.
+template <typename T>
+class AlignedArray {
+public:
+    AlignedArray() : ptr(nullptr), count(0) {}
+    explicit AlignedArray(size_t n) : ptr(nullptr), count(0) { allocate(n); }
+    ~AlignedArray() { free(ptr); }
+    AlignedArray(const AlignedArray&) = delete;
+    AlignedArray& operator=(const AlignedArray&) = delete;
+    AlignedArray(AlignedArray &&o) : ptr(o.ptr), count(o.count) { o.ptr = nullptr; o.count = 0; }
+    AlignedArray& operator=(AlignedArray &&o) { std::swap(ptr, o.ptr); std::swap(count, o.count); return *this; }
+
+    void allocate(size_t n) {
+        free(ptr);
+        ptr = nullptr;
+        count = n;
+        // Round up so the size is a multiple of the alignment, as aligned_alloc requires.
+        size_t bytes = (n * sizeof(T) + MATVEC_ALIGNMENT - 1) / MATVEC_ALIGNMENT * MATVEC_ALIGNMENT;
+        if (bytes > 0 && !(ptr = (T*) aligned_alloc(MATVEC_ALIGNMENT, bytes)))
+            throw std::bad_alloc();
+    }
+
+    T* data() { return ptr; }
+    const T* data() const { return ptr; }
+    size_t size() const { return count; }
+    T& operator[](size_t i) { return ptr[i]; }
+    const T& operator[](size_t i) const { return ptr[i]; }
+
+private:
+    T *ptr;
+    size_t count;
+};
+
+// Width of the column tiles in matmat_rows(). One tile of the matrix row and
+// of four right-hand sides (5 x 4 KB for 32-bit types) stays in L1 while it
+// is reused.
+const size_t MATMAT_TILE_COLS = 1024;
+
+template <typename T> struct Accumulator { typedef T type; };
+template <> struct Accumulator<int32_t> { typedef int64_t type; };
+
+// Each Ops struct provides the two inner products the tiled driver needs:
+//   dot1: returns a[0:len] . v[0:len]
+//   dot4: y[k] += a[0:len] . v[k*ldv : k*ldv+len] for k = 0..3
+// so a tile of the matrix row is loaded once for every four vectors.
+template <typename T>
+struct ScalarOps {
+    typedef typename Accumulator<T>::type Acc;
+
+    static Acc dot1(const T *a, const T *v, size_t len) {
+        Acc temp = 0;
+        for (size_t j = 0; j < len; j++)
+            temp += (Acc) a[j] * v[j];
+        return temp;
+    }
+    static void dot4(const T *a, const T *v, size_t ldv, size_t len, Acc *y) {
+        Acc t0 = 0, t1 = 0, t2 = 0, t3 = 0;
+        for (size_t j = 0; j < len; j++) {
+            Acc aj = a[j];
+            t0 += aj * v[j];
+            t1 += aj * v[ldv + j];
+            t2 += aj * v[2 * ldv + j];
+            t3 += aj * v[3 * ldv + j];
+        }
+        y[0] += t0; y[1] += t1; y[2] += t2; y[3] += t3;
+    }
+};
+
+// ---- AVX2 ----
+
+__attribute__((target("avx2")))
+inline int64_t hsum_epi64_avx2(__m256i v) {
+    __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi64(s, _mm_unpackhi_epi64(s, s));
+    return _mm_cvtsi128_si64(s);
+}
+
+__attribute__((target("avx2")))
+inline float hsum_ps_avx2(__m256 v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_movehdup_ps(s));
+    return _mm_cvtss_f32(s);
+}
+
+__attribute__((target("avx2")))
+inline double hsum_pd_avx2(__m256d v) {
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    s = _mm_add_sd(s, _mm_unpackhi_pd(s, s));
+    return _mm_cvtsd_f64(s);
+}
+
+// Sign-extending 32x32->64 multiply of all eight lanes, summed pairwise into
+// four int64 lanes. a_odd/x_odd hold the odd elements shifted into the low halves.
+__attribute__((target("avx2")))
+inline __m256i madd_epi32_epi64_avx2(__m256i acc, __m256i a, __m256i a_odd, __m256i x) {
+    __m256i x_odd = _mm256_srli_epi64(x, 32);
+    acc = _mm256_add_epi64(acc, _mm256_mul_epi32(a, x));
+    return _mm256_add_epi64(acc, _mm256_mul_epi32(a_odd, x_odd));
+}
+
+template <typename T> struct Avx2Ops;
+
+template <>
+struct Avx2Ops<int32_t> {
+    __attribute__((target("avx2")))
+    static int64_t dot1(const int32_t *a, const int32_t *v, size_t len) {
+        __m256i acc = _mm256_setzero_si256();
+        size_t j = 0;
+        for (; j + 8 <= len; j += 8) {
+            __m256i a0 = _mm256_loadu_si256((const __m256i*)(a + j));
+            acc = madd_epi32_epi64_avx2(acc, a0, _mm256_srli_epi64(a0, 32),
+                                        _mm256_loadu_si256((const __m256i*)(v + j)));
+        }
+        int64_t temp = hsum_epi64_avx2(acc);
+        for (; j < len; j++)
+            temp += (int64_t) a[j] * v[j];
+        return temp;
+    }
+
+    __attribute__((target("avx2")))
+    static void dot4(const int32_t *a, const int32_t *v, size_t ldv, size_t len, int64_t *y) {
+        const int32_t *v0 = v, *v1 = v + ldv, *v2 = v + 2 * ldv, *v3 = v + 3 * ldv;
+        __m256i acc0 = _mm256_setzero_si256();
+        __m256i acc1 = _mm256_setzero_si256();
+        __m256i acc2 = _mm256_setzero_si256();
+        __m256i acc3 = _mm256_setzero_si256();
+        size_t j = 0;
+        for (; j + 8 <= len; j += 8) {
+            __m256i a0 = _mm256_loadu_si256((const __m256i*)(a + j));
+            __m256i a_odd = _mm256_srli_epi64(a0, 32);
+            acc0 = madd_epi32_epi64_avx2(acc0, a0, a_odd, _mm256_loadu_si256((const __m256i*)(v0 + j)));
+            acc1 = madd_epi32_epi64_avx2(acc1, a0, a_odd, _mm256_loadu_si256((const __m256i*)(v1 + j)));
+            acc2 = madd_epi32_epi64_avx2(acc2, a0, a_odd, _mm256_loadu_si256((const __m256i*)(v2 + j)));
+            acc3 = madd_epi32_epi64_avx2(acc3, a0, a_odd, _mm256_loadu_si256((const __m256i*)(v3 + j)));
+        }
+        int64_t t0 = hsum_epi64_avx2(acc0), t1 = hsum_epi64_avx2(acc1);
+        int64_t t2 = hsum_epi64_avx2(acc2), t3 = hsum_epi64_avx2(acc3);
+        for (; j < len; j++) {
+            int64_t aj = a[j];
+            t0 += aj * v0[j];
+            t1 += aj * v1[j];
+            t2 += aj * v2[j];
+            t3 += aj * v3[j];
+        }
+        y[0] += t0; y[1] += t1; y[2] += t2; y[3] += t3;
+    }
+};
+
+template <>
+struct Avx2Ops<float> {
+    __attribute__((target("avx2,fma")))
+    static float dot1(const float *a, const float *v, size_t len) {
+        // Two independent accumulators hide the FMA latency.
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        size_t j = 0;
+        for (; j + 16 <= len; j += 16) {
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + j), _mm256_loadu_ps(v + j), acc0);
+            acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + j + 8), _mm256_loadu_ps(v + j + 8), acc1);
+        }
+        float temp = hsum_ps_avx2(_mm256_add_ps(acc0, acc1));
+        for (; j < len; j++)
+            temp += a[j] * v[j];
+        return temp;
+    }
+
+    __attribute__((target("avx2,fma")))
+    static void dot4(const float *a, const float *v, size_t ldv, size_t len, float *y) {
+        const float *v0 = v, *v1 = v + ldv, *v2 = v + 2 * ldv, *v3 = v + 3 * ldv;
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        __m256 acc2 = _mm256_setzero_ps();
+        __m256 acc3 = _mm256_setzero_ps();
+        size_t j = 0;
+        for (; j + 8 <= len; j += 8) {
+            __m256 a0 = _mm256_loadu_ps(a + j);
+            acc0 = _mm256_fmadd_ps(a0, _mm256_loadu_ps(v0 + j), acc0);
+            acc1 = _mm256_fmadd_ps(a0, _mm256_loadu_ps(v1 + j), acc1);
+            acc2 = _mm256_fmadd_ps(a0, _mm256_loadu_ps(v2 + j), acc2);
+            acc3 = _mm256_fmadd_ps(a0, _mm256_loadu_ps(v3 + j), acc3);
+        }
+        float t0 = hsum_ps_avx2(acc0), t1 = hsum_ps_avx2(acc1);
+        float t2 = hsum_ps_avx2(acc2), t3 = hsum_ps_avx2(acc3);
+        for (; j < len; j++) {
+            t0 += a[j] * v0[j];
+            t1 += a[j] * v1[j];
+            t2 += a[j] * v2[j];
+            t3 += a[j] * v3[j];
+        }
+        y[0] += t0; y[1] += t1; y[2] += t2; y[3] += t3;
+    }
+};
+
+template <>
+struct Avx2Ops<double> {
+    __attribute__((target("avx2,fma")))
+    static double dot1(const double *a, const double *v, size_t len) {
+        __m256d acc0 = _mm256_setzero_pd();
+        __m256d acc1 = _mm256_setzero_pd();
+        size_t j = 0;
+        for (; j + 8 <= len; j += 8) {
+            acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + j), _mm256_loadu_pd(v + j), acc0);
+            acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(a + j + 4), _mm256_loadu_pd(v + j + 4), acc1);
+        }
+        double temp = hsum_pd_avx2(_mm256_add_pd(acc0, acc1));
+        for (; j < len; j++)
+            temp += a[j] * v[j];
+        return temp;
+    }
+
+    __attribute__((target("avx2,fma")))
+    static void dot4(const double *a, const double *v, size_t ldv, size_t len, double *y) {
+        const double *v0 = v, *v1 = v + ldv, *v2 = v + 2 * ldv, *v3 = v + 3 * ldv;
+        __m256d acc0 = _mm256_setzero_pd();
+        __m256d acc1 = _mm256_setzero_pd();
+        __m256d acc2 = _mm256_setzero_pd();
+        __m256d acc3 = _mm256_setzero_pd();
+        size_t j = 0;
+        for (; j + 4 <= len; j += 4) {
+            __m256d a0 = _mm256_loadu_pd(a + j);
+            acc0 = _mm256_fmadd_pd(a0, _mm256_loadu_pd(v0 + j), acc0);
+            acc1 = _mm256_fmadd_pd(a0, _mm256_loadu_pd(v1 + j), acc1);
+            acc2 = _mm256_fmadd_pd(a0, _mm256_loadu_pd(v2 + j), acc2);
+            acc3 = _mm256_fmadd_pd(a0, _mm256_loadu_pd(v3 + j), acc3);
+        }
+        double t0 = hsum_pd_avx2(acc0), t1 = hsum_pd_avx2(acc1);
+        double t2 = hsum_pd_avx2(acc2), t3 = hsum_pd_avx2(acc3);
+        for (; j < len; j++) {
+            t0 += a[j] * v0[j];
+            t1 += a[j] * v1[j];
+            t2 += a[j] * v2[j];
+            t3 += a[j] * v3[j];
+        }
+        y[0] += t0; y[1] += t1; y[2] += t2; y[3] += t3;
+    }
+};
+
+// ---- AVX-512 ----
+// Masked loads handle the remainder of a tile without a scalar tail.
+
+__attribute__((target("avx512f")))
+inline __mmask16 tail_mask16(size_t left) {
+    return left >= 16 ? (__mmask16) 0xFFFF : (__mmask16) ((1u << left) - 1);
+}
+
+__attribute__((target("avx512f")))
+inline __mmask8 tail_mask8(size_t left) {
+    return left >= 8 ? (__mmask8) 0xFF : (__mmask8) ((1u << left) - 1);
+}
+
+// Lane sums through memory; the reduce intrinsics trip -Wmaybe-uninitialized in GCC 12.
+template <typename Acc, int N, typename V>
+__attribute__((target("avx512f")))
+inline Acc hsum_avx512(V v) {
+    alignas(64) Acc lanes[N];
+    memcpy(lanes, &v, sizeof(lanes));
+    Acc sum = 0;
+    for (int k = 0; k < N; k++)
+        sum += lanes[k];
+    return sum;
+}
+
+// The all-lanes maskz forms are used for the same reason: the unmasked shift
+// and multiply also start from an "undefined" vector GCC 12 warns about.
+const __mmask8 ALL_LANES8 = 0xFF;
+
+__attribute__((target("avx512f")))
+inline __m512i odd_epi32_avx512(__m512i x) {
+    return _mm512_maskz_srli_epi64(ALL_LANES8, x, 32);
+}
+
+__attribute__((target("avx512f")))
+inline __m512i madd_epi32_epi64_avx512(__m512i acc, __m512i a, __m512i a_odd, __m512i x) {
+    acc = _mm512_add_epi64(acc, _mm512_maskz_mul_epi32(ALL_LANES8, a, x));
+    return _mm512_add_epi64(acc, _mm512_maskz_mul_epi32(ALL_LANES8, a_odd, odd_epi32_avx512(x)));
+}
+
+template <typename T> struct Avx512Ops;
+
+template <>
+struct Avx512Ops<int32_t> {
+    __attribute__((target("avx512f")))
+    static int64_t dot1(const int32_t *a, const int32_t *v, size_t len) {
+        __m512i acc = _mm512_setzero_si512();
+        for (size_t j = 0; j < len; j += 16) {
+            __mmask16 m = tail_mask16(len - j);
+            __m512i a0 = _mm512_maskz_loadu_epi32(m, a + j);
+            acc = madd_epi32_epi64_avx512(acc, a0, odd_epi32_avx512(a0),
+                                          _mm512_maskz_loadu_epi32(m, v + j));
+        }
+        return hsum_avx512<int64_t, 8>(acc);
+    }
+
+    __attribute__((target("avx512f")))
+    static void dot4(const int32_t *a, const int32_t *v, size_t ldv, size_t len, int64_t *y) {
+        const int32_t *v0 = v, *v1 = v + ldv, *v2 = v + 2 * ldv, *v3 = v + 3 * ldv;
+        __m512i acc0 = _mm512_setzero_si512();
+        __m512i acc1 = _mm512_setzero_si512();
+        __m512i acc2 = _mm512_setzero_si512();
+        __m512i acc3 = _mm512_setzero_si512();
+        for (size_t j = 0; j < len; j += 16) {
+            __mmask16 m = tail_mask16(len - j);
+            __m512i a0 = _mm512_maskz_loadu_epi32(m, a + j);
+            __m512i a_odd = odd_epi32_avx512(a0);
+            acc0 = madd_epi32_epi64_avx512(acc0, a0, a_odd, _mm512_maskz_loadu_epi32(m, v0 + j));
+            acc1 = madd_epi32_epi64_avx512(acc1, a0, a_odd, _mm512_maskz_loadu_epi32(m, v1 + j));
+            acc2 = madd_epi32_epi64_avx512(acc2, a0, a_odd, _mm512_maskz_loadu_epi32(m, v2 + j));
+            acc3 = madd_epi32_epi64_avx512(acc3, a0, a_odd, _mm512_maskz_loadu_epi32(m, v3 + j));
+        }
+        y[0] += hsum_avx512<int64_t, 8>(acc0);
+        y[1] += hsum_avx512<int64_t, 8>(acc1);
+        y[2] += hsum_avx512<int64_t, 8>(acc2);
+        y[3] += hsum_avx512<int64_t, 8>(acc3);
+    }
+};
+
+template <>
+struct Avx512Ops<float> {
+    __attribute__((target("avx512f")))
+    static float dot1(const float *a, const float *v, size_t len) {
+        __m512 acc0 = _mm512_setzero_ps();
+        __m512 acc1 = _mm512_setzero_ps();
+        size_t j = 0;
+        for (; j + 32 <= len; j += 32) {
+            acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + j), _mm512_loadu_ps(v + j), acc0);
+            acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + j + 16), _mm512_loadu_ps(v + j + 16), acc1);
+        }
+        for (; j < len; j += 16) {
+            __mmask16 m = tail_mask16(len - j);
+            acc0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, a + j), _mm512_maskz_loadu_ps(m, v + j), acc0);
+        }
+        return hsum_avx512<float, 16>(_mm512_add_ps(acc0, acc1));
+    }
+
+    __attribute__((target("avx512f")))
+    static void dot4(const float *a, const float *v, size_t ldv, size_t len, float *y) {
+        const float *v0 = v, *v1 = v + ldv, *v2 = v + 2 * ldv, *v3 = v + 3 * ldv;
+        __m512 acc0 = _mm512_setzero_ps();
+        __m512 acc1 = _mm512_setzero_ps();
+        __m512 acc2 = _mm512_setzero_ps();
+        __m512 acc3 = _mm512_setzero_ps();
+        for (size_t j = 0; j < len; j += 16) {
+            __mmask16 m = tail_mask16(len - j);
+            __m512 a0 = _mm512_maskz_loadu_ps(m, a + j);
+            acc0 = _mm512_fmadd_ps(a0, _mm512_maskz_loadu_ps(m, v0 + j), acc0);
+            acc1 = _mm512_fmadd_ps(a0, _mm512_maskz_loadu_ps(m, v1 + j), acc1);
+            acc2 = _mm512_fmadd_ps(a0, _mm512_maskz_loadu_ps(m, v2 + j), acc2);
+            acc3 = _mm512_fmadd_ps(a0, _mm512_maskz_loadu_ps(m, v3 + j), acc3);
+        }
+        y[0] += hsum_avx512<float, 16>(acc0);
+        y[1] += hsum_avx512<float, 16>(acc1);
+        y[2] += hsum_avx512<float, 16>(acc2);
+        y[3] += hsum_avx512<float, 16>(acc3);
+    }
+};
+
+template <>
+struct Avx512Ops<double> {
+    __attribute__((target("avx512f")))
+    static double dot1(const double *a, const double *v, size_t len) {
+        __m512d acc0 = _mm512_setzero_pd();
+        __m512d acc1 = _mm512_setzero_pd();
+        size_t j = 0;
+        for (; j + 16 <= len; j += 16) {
+            acc0 = _mm512_fmadd_pd(_mm512_loadu_pd(a + j), _mm512_loadu_pd(v + j), acc0);
+            acc1 = _mm512_fmadd_pd(_mm512_loadu_pd(a + j + 8), _mm512_loadu_pd(v + j + 8), acc1);
+        }
+        for (; j < len; j += 8) {
+            __mmask8 m = tail_mask8(len - j);
+            acc0 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(m, a + j), _mm512_maskz_loadu_pd(m, v + j), acc0);
+        }
+        return hsum_avx512<double, 8>(_mm512_add_pd(acc0, acc1));
+    }
+
+    __attribute__((target("avx512f")))
+    static void dot4(const double *a, const double *v, size_t ldv, size_t len, double *y) {
+        const double *v0 = v, *v1 = v + ldv, *v2 = v + 2 * ldv, *v3 = v + 3 * ldv;
+        __m512d acc0 = _mm512_setzero_pd();
+        __m512d acc1 = _mm512_setzero_pd();
+        __m512d acc2 = _mm512_setzero_pd();
+        __m512d acc3 = _mm512_setzero_pd();
+        for (size_t j = 0; j < len; j += 8) {
+            __mmask8 m = tail_mask8(len - j);
+            __m512d a0 = _mm512_maskz_loadu_pd(m, a + j);
+            acc0 = _mm512_fmadd_pd(a0, _mm512_maskz_loadu_pd(m, v0 + j), acc0);
+            acc1 = _mm512_fmadd_pd(a0, _mm512_maskz_loadu_pd(m, v1 + j), acc1);
+            acc2 = _mm512_fmadd_pd(a0, _mm512_maskz_loadu_pd(m, v2 + j), acc2);
+            acc3 = _mm512_fmadd_pd(a0, _mm512_maskz_loadu_pd(m, v3 + j), acc3);
+        }
+        y[0] += hsum_avx512<double, 8>(acc0);
+        y[1] += hsum_avx512<double, 8>(acc1);
+        y[2] += hsum_avx512<double, 8>(acc2);
+        y[3] += hsum_avx512<double, 8>(acc3);
+    }
+};
+
+// Y[i][k] = A[i][:] . V[k][:] for row_begin <= i < row_end and 0 <= k < nvec,
+// with V stored as nvec x cols and Y as rows x nvec. The columns are walked in
+// tiles and, within a tile, the vectors four at a time, so every element of A
+// is read from memory once per batch instead of once per vector.
+template <typename T, typename Ops>
+void matmat_rows_tiled(const T *A, size_t cols, const T *V, size_t nvec,
+                       typename Accumulator<T>::type *Y, size_t row_begin, size_t row_end) {
+    typedef typename Accumulator<T>::type Acc;
+    for (size_t i = row_begin * nvec; i < row_end * nvec; i++)
+        Y[i] = 0;
+    for (size_t j0 = 0; j0 < cols; j0 += MATMAT_TILE_COLS) {
+        size_t len = cols - j0 < MATMAT_TILE_COLS ? cols - j0 : MATMAT_TILE_COLS;
+        for (size_t i = row_begin; i < row_end; i++) {
+            const T *a = A + i * cols + j0;
+            Acc *y = Y + i * nvec;
+            size_t k = 0;
+            for (; k + 4 <= nvec; k += 4)
+                Ops::dot4(a, V + k * cols + j0, cols, len, y + k);
+            for (; k < nvec; k++)
+                y[k] += Ops::dot1(a, V + k * cols + j0, len);
+        }
+    }
+}
+
+template <typename T>
+struct MatmatKernel {
+    typedef void (*type)(const T *A, size_t cols, const T *V, size_t nvec,
+                         typename Accumulator<T>::type *Y, size_t row_begin, size_t row_end);
+};
+
+// Element types without a SIMD kernel (int64) always use the scalar one.
+template <typename T>
+inline typename MatmatKernel<T>::type select_matmat_kernel() {
+    return matmat_rows_tiled<T, ScalarOps<T> >;
+}
+
+template <typename T>
+inline typename MatmatKernel<T>::type select_simd_matmat_kernel() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return matmat_rows_tiled<T, Avx512Ops<T> >;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return matmat_rows_tiled<T, Avx2Ops<T> >;
+    return matmat_rows_tiled<T, ScalarOps<T> >;
+}
+
+template <>
+inline MatmatKernel<int32_t>::type select_matmat_kernel<int32_t>() { return select_simd_matmat_kernel<int32_t>(); }
+template <>
+inline MatmatKernel<float>::type select_matmat_kernel<float>() { return select_simd_matmat_kernel<float>(); }
+template <>
+inline MatmatKernel<double>::type select_matmat_kernel<double>() { return select_simd_matmat_kernel<double>(); }
+
+// Batched product over a range of rows, see matmat_rows_tiled().
+template <typename T>
+inline void matmat_rows(const T *A, size_t cols, const T *V, size_t nvec,
+                        typename Accumulator<T>::type *Y, size_t row_begin, size_t row_end) {
+    static const typename MatmatKernel<T>::type kernel = select_matmat_kernel<T>();
+    kernel(A, cols, V, nvec, Y, row_begin, row_end);
+}
+
+// y[i] = A[i][:] . x for row_begin <= i < row_end.
+template <typename T>
+inline void matvec_rows(const T *A, size_t cols, const T *x,
+                        typename Accumulator<T>::type *y, size_t row_begin, size_t row_end) {
+    matmat_rows(A, cols, x, 1, y, row_begin, row_end);
+}
+
+#endif
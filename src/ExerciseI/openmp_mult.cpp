@@ -1,59 +1,212 @@
-#include <iostream>
-#include <cstdlib>
-#include <omp.h>
-
-using namespace std;
-
-int main(int argc, char* argv[]){
-    if(argc < 4) {
-        cout << "Usage: " << argv[0] << " <rows> <cols> <matrix values>... <vector values>..." << endl;
-        return 1;
-    }
-    
-    int rows = atoi(argv[1]);
-    int cols = atoi(argv[2]);
-    int **matrix = new int*[rows];
-    for(int i = 0; i < rows; i++){
-        matrix[i] = new int[cols];
-    }
-    
-    int *vec = new int[cols];
-    int *result = new int[rows];
-    int arg_index = 3;
-    for (int i = 0; i < rows; i++){
-        for (int j = 0; j < cols; j++) {
-            matrix[i][j] = atoi(argv[arg_index++]);
-        }
-    }
-    
-    for (int j = 0; j < cols; j++){
-        vec[j] = atoi(argv[arg_index++]);
-    }
-    
-    int num_threads = 4;
-    omp_set_num_threads(num_threads);
-    
-    #pragma omp parallel for schedule(static)
-    for (int i = 0; i < rows; i++){
-        int temp = 0;
-        for (int j = 0; j < cols; j++){
-            temp += matrix[i][j] * vec[j];
-        }
-        result[i] = temp;
-    }
-    
-    cout << "Result (size " << rows << "):" << endl << "{ ";
-    for (int i = 0; i < rows; i++){
-        cout << result[i] << " ";
-    }
-    cout << "}" << endl;
-    
-    for (int i = 0; i < rows; i++){
-        delete[] matrix[i];
-    }
-    delete[] matrix;
-    delete[] vec;
-    delete[] result;
-    
-    return 0;
-}
\ No newline at end of file
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <omp.h>
+#include <sched.h>
+#include "matvec_io.h"
+#include "sparse_matrix.h"
+
+using namespace std;
+
+// Rows handed out per loop iteration; a block shares the cached vector tiles.
+const int ROW_BLOCK = 32;
+
+// Thread placement, following the OMP_PROC_BIND policies of the same name.
+enum BindPolicy { BIND_NONE, BIND_CLOSE, BIND_SPREAD };
+
+// Pins every thread of the team to one CPU of the process affinity mask:
+// "close" packs consecutive threads on consecutive CPUs, "spread" spaces them
+// evenly over the mask. The binding is done by hand because libgomp ignores
+// proc_bind clauses unless OMP_PLACES/OMP_PROC_BIND were set at startup.
+// Later parallel regions of the same size reuse the pinned threads.
+void bind_threads(BindPolicy bind) {
+    cpu_set_t allowed;
+    if (bind == BIND_NONE || sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return;
+    vector<int> cpus;
+    for (int c = 0; c < CPU_SETSIZE; c++){
+        if (CPU_ISSET(c, &allowed))
+            cpus.push_back(c);
+    }
+    int ncpus = (int) cpus.size();
+
+    #pragma omp parallel
+    {
+        int t = omp_get_thread_num();
+        int n = omp_get_num_threads();
+        int slot = (bind == BIND_CLOSE) ? t % ncpus
+                                        : (int) ((long) t * ncpus / n) % ncpus;
+        cpu_set_t mine;
+        CPU_ZERO(&mine);
+        CPU_SET(cpus[slot], &mine);
+        sched_setaffinity(0, sizeof(mine), &mine);
+    }
+}
+
+// Multiplies with element type T once the team is configured.
+template <typename T>
+void multiply(const MatvecInput &in, bool first_touch){
+    typedef typename Accumulator<T>::type Acc;
+
+    int rows = in.rows;
+    int cols = in.cols;
+    const T *matrix = (const T*) in.matrix;  // Flattened matrix (row-major)
+    int nvec = in.nvec;
+    const T *vec = (const T*) in.vec;        // nvec vectors, multiplied in one pass
+    Acc *result = new Acc[(size_t)rows * nvec];
+    
+    // NUMA first touch: copy the matrix into fresh (untouched) pages using the
+    // same loop and schedule as the multiplication, so each page is faulted in
+    // on the node of the thread that later reads it. This only lines up with
+    // a static schedule, and pays off with --bind.
+    AlignedArray<T> local_matrix;
+    if (first_touch) {
+        local_matrix.allocate((size_t)rows * cols);
+        T *dst = local_matrix.data();
+        #pragma omp parallel for schedule(runtime)
+        for (int b = 0; b < rows; b += ROW_BLOCK){
+            int end = b + ROW_BLOCK < rows ? b + ROW_BLOCK : rows;
+            memcpy(dst + (size_t)b * cols, matrix + (size_t)b * cols,
+                   (size_t)(end - b) * cols * sizeof(T));
+        }
+        matrix = dst;
+    }
+    
+    #pragma omp parallel for schedule(runtime)
+    for (int b = 0; b < rows; b += ROW_BLOCK){
+        int end = b + ROW_BLOCK < rows ? b + ROW_BLOCK : rows;
+        matmat_rows(matrix, cols, vec, nvec, result, b, end);
+    }
+    
+    print_result(result, rows, nvec);
+    
+    delete[] result;
+}
+
+// Sparse product with element type T. Row blocks are multiples of SELL_CHUNK,
+// so with SELL-C-sigma no chunk is split between threads.
+template <typename T>
+int multiply_sparse(const SparseInput &in){
+    typedef typename Accumulator<T>::type Acc;
+    static_assert(ROW_BLOCK % SELL_CHUNK == 0, "row blocks must hold whole SELL chunks");
+
+    SparseMatrix<T> matrix;
+    if (!load_sparse_matrix(in, matrix))
+        return 1;
+    int rows = matrix.rows();
+    int nvec = in.nvec;
+    const T *vec = (const T*) in.vec_file.data();
+    Acc *result = new Acc[(size_t)rows * nvec];
+    
+    #pragma omp parallel for schedule(runtime)
+    for (int b = 0; b < rows; b += ROW_BLOCK){
+        int end = b + ROW_BLOCK < rows ? b + ROW_BLOCK : rows;
+        sparse_matmat_rows(matrix, vec, nvec, result, b, end);
+    }
+    
+    print_result(result, rows, nvec);
+    
+    delete[] result;
+    return 0;
+}
+
+void print_options() {
+    cout << "Options: --threads <n> --schedule static|dynamic|guided --chunk <rows>" << endl
+         << "         --bind none|close|spread --first-touch on|off --format csr|sell" << endl;
+}
+
+// Checks the values of the optional flags, so a typo cannot quietly run a
+// different configuration. Prints an error and returns false on the first
+// invalid one.
+bool check_options(const char *threads_opt, const char *schedule_opt, const char *chunk_opt,
+                   const char *bind_opt, const char *first_touch_opt) {
+    if (threads_opt && atoi(threads_opt) < 1) {
+        cerr << "Error: --threads must be at least 1" << endl;
+        return false;
+    }
+    if (schedule_opt && strcmp(schedule_opt, "static") != 0 && strcmp(schedule_opt, "dynamic") != 0 &&
+        strcmp(schedule_opt, "guided") != 0) {
+        cerr << "Error: --schedule must be static, dynamic or guided" << endl;
+        return false;
+    }
+    if (chunk_opt && atoi(chunk_opt) < 1) {
+        cerr << "Error: --chunk must be at least 1" << endl;
+        return false;
+    }
+    if (bind_opt && strcmp(bind_opt, "none") != 0 && strcmp(bind_opt, "close") != 0 &&
+        strcmp(bind_opt, "spread") != 0) {
+        cerr << "Error: --bind must be none, close or spread" << endl;
+        return false;
+    }
+    if (first_touch_opt && strcmp(first_touch_opt, "on") != 0 && strcmp(first_touch_opt, "off") != 0) {
+        cerr << "Error: --first-touch must be on or off" << endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]){
+    // Optional flags, removed from argv before the input is parsed.
+    const char *threads_opt = take_option(argc, argv, "--threads");
+    const char *schedule_opt = take_option(argc, argv, "--schedule");
+    const char *chunk_opt = take_option(argc, argv, "--chunk");
+    const char *bind_opt = take_option(argc, argv, "--bind");
+    const char *first_touch_opt = take_option(argc, argv, "--first-touch");
+    const char *format_opt = take_option(argc, argv, "--format");
+    if (!check_options(threads_opt, schedule_opt, chunk_opt, bind_opt, first_touch_opt)) {
+        print_options();
+        return 1;
+    }
+
+    bool sparse = is_sparse_input(argc, argv);
+    MatvecInput in;
+    SparseInput sin;
+    if (sparse ? !open_sparse_input(argv, format_opt, sin) : !load_input(argc, argv, in)) {
+        print_options();
+        return 1;
+    }
+    
+    // Without --threads the OpenMP default (OMP_NUM_THREADS or all cores) applies.
+    if (threads_opt)
+        omp_set_num_threads(atoi(threads_opt));
+    
+    // The loops below use schedule(runtime); the chunk is given in rows and
+    // converted to row blocks. Without --schedule OMP_SCHEDULE still applies.
+    omp_sched_t kind = omp_sched_static;
+    if (schedule_opt && strcmp(schedule_opt, "dynamic") == 0)
+        kind = omp_sched_dynamic;
+    else if (schedule_opt && strcmp(schedule_opt, "guided") == 0)
+        kind = omp_sched_guided;
+    int chunk_blocks = chunk_opt ? (atoi(chunk_opt) + ROW_BLOCK - 1) / ROW_BLOCK : 0;
+    if (schedule_opt || chunk_opt)
+        omp_set_schedule(kind, chunk_blocks);
+    else if (!getenv("OMP_SCHEDULE"))
+        omp_set_schedule(omp_sched_static, 0);
+    
+    BindPolicy bind = BIND_NONE;
+    if (bind_opt && strcmp(bind_opt, "close") == 0)
+        bind = BIND_CLOSE;
+    else if (bind_opt && strcmp(bind_opt, "spread") == 0)
+        bind = BIND_SPREAD;
+    bind_threads(bind);
+    
+    if (sparse) {
+        switch (sin.dtype) {
+            case DTYPE_INT64:   return multiply_sparse<int64_t>(sin);
+            case DTYPE_FLOAT32: return multiply_sparse<float>(sin);
+            case DTYPE_FLOAT64: return multiply_sparse<double>(sin);
+            default:            return multiply_sparse<int32_t>(sin);
+        }
+    }
+    
+    bool first_touch = first_touch_opt && strcmp(first_touch_opt, "on") == 0;
+    switch (in.dtype) {
+        case DTYPE_INT64:   multiply<int64_t>(in, first_touch); break;
+        case DTYPE_FLOAT32: multiply<float>(in, first_touch); break;
+        case DTYPE_FLOAT64: multiply<double>(in, first_touch); break;
+        default:            multiply<int32_t>(in, first_touch); break;
+    }
+    
+    return 0;
+}
@@ -1,132 +1,278 @@
-#include <mpi.h>
-#include <iostream>
-#include <cstdlib>
-using namespace std;
-
-int main(int argc, char* argv[]){
-    MPI_Init(&argc, &argv);
-
-    int rank, num_procs;
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &num_procs);
-
-    int rows, cols;
-    int *matrix = nullptr;  // Flattened matrix (stored in row-major order)
-    int *vec = nullptr;
-    int *result = nullptr;
-
-    // Process 0 reads the input from command-line.
-    if (rank == 0) {
-        if(argc < 4) {
-            cout << "Usage: " << argv[0] 
-                 << " <rows> <cols> <matrix values>... <vector values>..." << endl;
-            MPI_Abort(MPI_COMM_WORLD, 1);
-            return 1;
-        }
-        rows = atoi(argv[1]);
-        cols = atoi(argv[2]);
-        
-        // Allocate and read the matrix as a 1D array (flattened)
-        matrix = new int[rows * cols];
-        int arg_index = 3;
-        for (int i = 0; i < rows * cols; i++){
-            matrix[i] = atoi(argv[arg_index++]);
-        }
-        
-        // Allocate and read the vector.
-        vec = new int[cols];
-        for (int i = 0; i < cols; i++){
-            vec[i] = atoi(argv[arg_index++]);
-        }
-        
-        // Allocate the result array.
-        result = new int[rows];
-    }
-
-    // Broadcast the matrix dimensions to all processes.
-    MPI_Bcast(&rows, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&cols, 1, MPI_INT, 0, MPI_COMM_WORLD);
-
-    // Ensure all processes allocate the vector.
-    if (rank != 0) {
-        vec = new int[cols];
-    }
-    // Broadcast the vector from process 0 to all others.
-    MPI_Bcast(vec, cols, MPI_INT, 0, MPI_COMM_WORLD);
-
-    // Determine how many rows each process will handle.
-    // We use MPI_Scatterv so that if rows % num_procs != 0, the extra rows are distributed.
-    int *sendcounts = new int[num_procs];
-    int *displs = new int[num_procs];
-    for (int i = 0; i < num_procs; i++){
-        // Each process gets (rows/num_procs) rows, plus one extra if i < rows % num_procs.
-        int local_rows = rows / num_procs + (i < (rows % num_procs) ? 1 : 0);
-        sendcounts[i] = local_rows * cols;  // number of matrix elements for process i.
-    }
-    displs[0] = 0;
-    for (int i = 1; i < num_procs; i++){
-        displs[i] = displs[i-1] + sendcounts[i-1];
-    }
-    // Determine local number of rows for this process.
-    int local_rows = sendcounts[rank] / cols;
-    
-    // Allocate buffer for the local block of the matrix.
-    int *local_matrix = new int[local_rows * cols];
-    
-    // Scatter the matrix rows among all processes.
-    MPI_Scatterv(matrix, sendcounts, displs, MPI_INT,
-                 local_matrix, sendcounts[rank], MPI_INT,
-                 0, MPI_COMM_WORLD);
-    
-    // Each process computes its partial matrix-vector multiplication.
-    int *local_result = new int[local_rows];
-    for (int i = 0; i < local_rows; i++){
-        local_result[i] = 0;
-        for (int j = 0; j < cols; j++){
-            local_result[i] += local_matrix[i * cols + j] * vec[j];
-        }
-    }
-    
-    // Prepare arrays for gathering the results.
-    int *recvcounts = new int[num_procs];
-    int *recvdispls = new int[num_procs];
-    for (int i = 0; i < num_procs; i++){
-        recvcounts[i] = sendcounts[i] / cols;  // Each process sends one integer per row.
-    }
-    recvdispls[0] = 0;
-    for (int i = 1; i < num_procs; i++){
-        recvdispls[i] = recvdispls[i-1] + recvcounts[i-1];
-    }
-    
-    // Gather the partial results into the final result array at process 0.
-    MPI_Gatherv(local_result, local_rows, MPI_INT,
-                result, recvcounts, recvdispls, MPI_INT,
-                0, MPI_COMM_WORLD);
-    
-    // Process 0 prints the final result.
-    if (rank == 0){
-        cout << "Result (size " << rows << "):" << endl << "{ ";
-        for (int i = 0; i < rows; i++){
-            cout << result[i] << " ";
-        }
-        cout << "}" << endl;
-    }
-    
-    // Free dynamically allocated memory.
-    if (rank == 0) {
-        delete[] matrix;
-        delete[] vec;
-        delete[] result;
-    } else {
-        delete[] vec;
-    }
-    delete[] local_matrix;
-    delete[] local_result;
-    delete[] sendcounts;
-    delete[] displs;
-    delete[] recvcounts;
-    delete[] recvdispls;
-    
-    MPI_Finalize();
-    return 0;
-}
+#include <mpi.h>
+#include <iostream>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include "matvec_io.h"
+#include "sparse_matrix.h"
+using namespace std;
+
+// The processes form a grid_rows x grid_cols grid. Process (pr, pc) owns the
+// matrix block made of row block pr and column block pc, plus column block pc
+// of the vectors. Only grid row 0 loads the vector slices; each one is then
+// broadcast down its grid column, so a process receives cols/grid_cols vector
+// entries instead of the whole vector. Partial results are summed along each
+// grid row onto grid column 0 and gathered to process 0 for printing.
+//
+// With binary input every process reads its own block straight from the file
+// with collective MPI-IO, so loading scales with the number of processes.
+// With sparse input (--mtx) every process keeps only the nonzeros of its
+// block while scanning the Matrix Market file, and copies its vector slices
+// from its own mapping of the vector file.
+
+// MPI datatype of each element and accumulator type.
+template <typename T> MPI_Datatype mpi_type();
+template <> MPI_Datatype mpi_type<int32_t>() { return MPI_INT32_T; }
+template <> MPI_Datatype mpi_type<int64_t>() { return MPI_INT64_T; }
+template <> MPI_Datatype mpi_type<float>()   { return MPI_FLOAT; }
+template <> MPI_Datatype mpi_type<double>()  { return MPI_DOUBLE; }
+
+struct ProcessGrid {
+    int dims[2];
+    int coords[2];
+    MPI_Comm grid_comm, row_comm, col_comm;
+};
+
+// Collectively reads the row_count x col_count window at (row_begin, col_begin)
+// of a file_rows x file_cols matrix file of T into buf. Every process of comm
+// passes its own window (possibly empty).
+template <typename T>
+void read_block_mpiio(MPI_Comm comm, const char *path, int file_rows, int file_cols,
+                      int row_begin, int row_count, int col_begin, int col_count, T *buf) {
+    MPI_File fh;
+    if (MPI_File_open(comm, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        cerr << "Error: cannot open " << path << endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    MPI_Datatype etype = mpi_type<T>();
+    MPI_Datatype filetype = etype;
+    if (row_count > 0 && col_count > 0) {
+        int sizes[2] = {file_rows, file_cols};
+        int subsizes[2] = {row_count, col_count};
+        int starts[2] = {row_begin, col_begin};
+        MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, etype, &filetype);
+        MPI_Type_commit(&filetype);
+    }
+    MPI_File_set_view(fh, sizeof(MatrixFileHeader), etype, filetype, "native", MPI_INFO_NULL);
+    MPI_File_read_at_all(fh, 0, buf, row_count * col_count, etype, MPI_STATUS_IGNORE);
+    if (filetype != etype)
+        MPI_Type_free(&filetype);
+    MPI_File_close(&fh);
+}
+
+// Sums the local_rows x nvec partial results along each grid row and gathers
+// the row blocks on process 0, which prints them.
+template <typename Acc>
+void collect_result(const Acc *partial, int local_rows, int rows, int nvec, const ProcessGrid &g) {
+    // Sum the partial results along the grid row onto grid column 0.
+    Acc *local_result = (g.coords[1] == 0) ? new Acc[(size_t)local_rows * nvec] : nullptr;
+    MPI_Reduce(partial, local_result, local_rows * nvec, mpi_type<Acc>(), MPI_SUM, 0, g.row_comm);
+
+    // Grid column 0 gathers the row blocks into the final result at process 0.
+    Acc *result = nullptr;
+    if (g.coords[1] == 0) {
+        int *recvcounts = nullptr;
+        int *recvdispls = nullptr;
+        if (g.coords[0] == 0) {
+            result = new Acc[(size_t)rows * nvec];
+            recvcounts = new int[g.dims[0]];
+            recvdispls = new int[g.dims[0]];
+            for (int i = 0; i < g.dims[0]; i++){
+                int begin, count;
+                block_range(rows, g.dims[0], i, begin, count);
+                recvcounts[i] = count * nvec;  // Each process sends nvec results per row.
+                recvdispls[i] = begin * nvec;
+            }
+        }
+        MPI_Gatherv(local_result, local_rows * nvec, mpi_type<Acc>(),
+                    result, recvcounts, recvdispls, mpi_type<Acc>(),
+                    0, g.col_comm);
+        delete[] recvcounts;
+        delete[] recvdispls;
+    }
+
+    // Process 0 prints the final result.
+    if (g.coords[0] == 0 && g.coords[1] == 0){
+        print_result(result, rows, nvec);
+    }
+
+    // Free dynamically allocated memory.
+    delete[] result;
+    delete[] local_result;
+}
+
+// Loads this process's blocks, multiplies and collects the result on process 0.
+template <typename T>
+void multiply(MatvecBlock &blk, const ProcessGrid &g, char* argv[]) {
+    typedef typename Accumulator<T>::type Acc;
+    int rows = blk.rows, cols = blk.cols, nvec = blk.nvec;
+
+    // This process's block of the matrix.
+    int row_begin, local_rows, col_begin, local_cols;
+    block_range(rows, g.dims[0], g.coords[0], row_begin, local_rows);
+    block_range(cols, g.dims[1], g.coords[1], col_begin, local_cols);
+    if (blk.binary) {
+        blk.matrix.allocate((size_t)local_rows * local_cols * sizeof(T));
+        read_block_mpiio(g.grid_comm, argv[2], rows, cols, row_begin, local_rows,
+                         col_begin, local_cols, block_data<T>(blk.matrix));
+    } else {
+        read_matrix_block(blk, row_begin, local_rows, col_begin, local_cols);
+    }
+
+    // Grid row 0 reads the vector slices and broadcasts them down the columns.
+    if (g.coords[0] == 0 && blk.binary) {
+        blk.vec.allocate((size_t)nvec * local_cols * sizeof(T));
+        read_block_mpiio(g.row_comm, argv[3], nvec, cols, 0, nvec,
+                         col_begin, local_cols, block_data<T>(blk.vec));
+    } else if (g.coords[0] == 0) {
+        read_vector_block(blk, col_begin, local_cols);
+    } else {
+        blk.vec.allocate((size_t)nvec * local_cols * sizeof(T));
+    }
+    MPI_Bcast(blk.vec.data(), nvec * local_cols, mpi_type<T>(), 0, g.col_comm);
+
+    // Each process multiplies its block by its slice of all vectors in one pass.
+    Acc *partial = new Acc[(size_t)local_rows * nvec];
+    matmat_rows(block_data<T>(blk.matrix), local_cols, block_data<T>(blk.vec), nvec,
+                partial, 0, local_rows);
+
+    collect_result(partial, local_rows, rows, nvec, g);
+    delete[] partial;
+}
+
+// Sparse counterpart of multiply(): same grid, same result collection.
+template <typename T>
+void multiply_sparse(const SparseInput &in, int rows, int cols, const ProcessGrid &g) {
+    typedef typename Accumulator<T>::type Acc;
+    int nvec = in.nvec;
+
+    int row_begin, local_rows, col_begin, local_cols;
+    block_range(rows, g.dims[0], g.coords[0], row_begin, local_rows);
+    block_range(cols, g.dims[1], g.coords[1], col_begin, local_cols);
+    SparseMatrix<T> block;
+    if (!load_matrix_market(in.matrix_path, row_begin, local_rows, col_begin, local_cols, block.csr))
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    block.format = in.format;
+    if (block.format == FORMAT_SELL)
+        csr_to_sell(block.csr, block.sell);
+
+    AlignedArray<T> vec((size_t)nvec * local_cols);
+    for (int k = 0; k < nvec; k++){
+        memcpy(vec.data() + (size_t)k * local_cols,
+               (const T*) in.vec_file.data() + (size_t)k * cols + col_begin,
+               (size_t)local_cols * sizeof(T));
+    }
+
+    Acc *partial = new Acc[(size_t)local_rows * nvec];
+    sparse_matmat_rows(block, vec.data(), nvec, partial, 0, local_rows);
+    collect_result(partial, local_rows, rows, nvec, g);
+    delete[] partial;
+}
+
+int main(int argc, char* argv[]){
+    MPI_Init(&argc, &argv);
+
+    int rank, num_procs;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &num_procs);
+
+    // Optional "--grid <rows>x<cols>", e.g. "--grid 4x1" for the old row split.
+    const char *grid_opt = take_option(argc, argv, "--grid");
+    const char *format_opt = take_option(argc, argv, "--format");
+    bool sparse = is_sparse_input(argc, argv);
+    int dims[2] = {0, 0};
+    if (grid_opt && (sscanf(grid_opt, "%dx%d", &dims[0], &dims[1]) != 2 ||
+                     dims[0] < 1 || dims[1] < 1 || dims[0] * dims[1] != num_procs)) {
+        if (rank == 0)
+            cerr << "Error: --grid must be <rows>x<cols> with rows*cols = " << num_procs << endl;
+        MPI_Finalize();
+        return 1;
+    }
+    ProcessGrid g;
+    MPI_Dims_create(num_procs, 2, dims);
+    g.dims[0] = dims[0];
+    g.dims[1] = dims[1];
+
+    // Process 0 validates the input (file headers or argv count) and shares
+    // the sizes, so errors are reported once.
+    MatvecBlock blk;
+    SparseInput sin;
+    MatrixMarketInfo mm;
+    int info[6] = {0, 0, 0, 0, 0, 0};  // ok, rows, cols, nvec, binary, dtype
+    if (rank == 0 && sparse) {
+        if (open_sparse_input(argv, format_opt, sin) && read_matrix_market_info(sin.matrix_path, mm)) {
+            if (sin.vec_file.cols() == (uint64_t) mm.cols) {
+                info[0] = 1;
+                info[1] = mm.rows;
+                info[2] = mm.cols;
+                info[3] = sin.nvec;
+                info[5] = (int) sin.dtype;
+            } else {
+                cerr << "Error: vector file must be K x " << mm.cols << endl;
+            }
+        }
+    } else if (rank == 0 && open_input_block(argc, argv, blk)) {
+        info[0] = 1;
+        info[1] = blk.rows;
+        info[2] = blk.cols;
+        info[3] = blk.nvec;
+        info[4] = blk.binary;
+        info[5] = (int) blk.dtype;
+        // The data itself is read collectively below, not through this mapping.
+        blk.matrix_file.close();
+        blk.vec_file.close();
+    }
+    MPI_Bcast(info, 6, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!info[0]) {
+        MPI_Finalize();
+        return 1;
+    }
+    // Sparse input: every process maps the vector file itself.
+    if (sparse && rank != 0 && !open_sparse_input(argv, format_opt, sin)) {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+        return 1;
+    }
+    // In argv mode every process parses its own block from its copy of argv.
+    if (!sparse && !info[4] && rank != 0 && !open_input_block(argc, argv, blk)) {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+        return 1;
+    }
+    blk.rows = info[1];
+    blk.cols = info[2];
+    blk.nvec = info[3];
+    blk.binary = info[4];
+    blk.dtype = (uint32_t) info[5];
+
+    // Build the 2D grid (no reordering, so process 0 stays at (0, 0)) and the
+    // communicators along its rows and columns.
+    int periods[2] = {0, 0};
+    MPI_Cart_create(MPI_COMM_WORLD, 2, g.dims, periods, 0, &g.grid_comm);
+    MPI_Cart_coords(g.grid_comm, rank, 2, g.coords);
+    int keep_cols[2] = {0, 1};  // same grid row, varying column
+    int keep_rows[2] = {1, 0};  // same grid column, varying row
+    MPI_Cart_sub(g.grid_comm, keep_cols, &g.row_comm);
+    MPI_Cart_sub(g.grid_comm, keep_rows, &g.col_comm);
+
+    if (sparse) {
+        switch (blk.dtype) {
+            case DTYPE_INT64:   multiply_sparse<int64_t>(sin, blk.rows, blk.cols, g); break;
+            case DTYPE_FLOAT32: multiply_sparse<float>(sin, blk.rows, blk.cols, g); break;
+            case DTYPE_FLOAT64: multiply_sparse<double>(sin, blk.rows, blk.cols, g); break;
+            default:            multiply_sparse<int32_t>(sin, blk.rows, blk.cols, g); break;
+        }
+    } else {
+        switch (blk.dtype) {
+            case DTYPE_INT64:   multiply<int64_t>(blk, g, argv); break;
+            case DTYPE_FLOAT32: multiply<float>(blk, g, argv); break;
+            case DTYPE_FLOAT64: multiply<double>(blk, g, argv); break;
+            default:            multiply<int32_t>(blk, g, argv); break;
+        }
+    }
+
+    MPI_Comm_free(&g.row_comm);
+    MPI_Comm_free(&g.col_comm);
+    MPI_Comm_free(&g.grid_comm);
+
+    MPI_Finalize();
+    return 0;
+}
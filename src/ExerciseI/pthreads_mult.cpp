@@ -1,99 +1,242 @@
-#include <iostream>
-#include <cstdlib>
-#include <pthread.h>
-using namespace std;
-
-struct ThreadData {
-    int thread_id;      
-    int num_threads;    
-    int rows;           
-    int cols;           
-    int **matrix;       
-    int *vec;           
-    int *result;        
-};
-
-void* thread_multiply(void *arg) {
-    ThreadData *data = (ThreadData*) arg;
-    int rows_per_thread = data->rows / data->num_threads;
-    int start_row = data->thread_id * rows_per_thread;
-    int end_row = (data->thread_id == data->num_threads - 1) 
-                  ? data->rows 
-                  : start_row + rows_per_thread;
-    
-    for (int i = start_row; i < end_row; i++) {
-        data->result[i] = 0;
-        for (int j = 0; j < data->cols; j++) {
-            data->result[i] += data->matrix[i][j] * data->vec[j];
-        }
-    }
-    
-    pthread_exit(NULL);
-}
-
-int main(int argc, char* argv[]){
-    if(argc < 4) {
-        cout << "Usage: " << argv[0] << " <rows> <cols> <matrix values>... <vector values>..." << endl;
-        return 1;
-    }
-    
-    int rows = atoi(argv[1]);
-    int cols = atoi(argv[2]);
-    
-    int **matrix = new int*[rows];
-    for(int i = 0; i < rows; i++){
-        matrix[i] = new int[cols];
-    }
-    
-    int *vec = new int[cols];
-    int *result = new int[rows];
-    
-    int arg_index = 3;
-    for (int i = 0; i < rows; i++){
-        for (int j = 0; j < cols; j++) {
-            matrix[i][j] = atoi(argv[arg_index++]);
-        }
-    }
-    for (int j = 0; j < cols; j++){
-        vec[j] = atoi(argv[arg_index++]);
-    }
-    
-    int num_threads = 4;
-    pthread_t threads[num_threads];
-    ThreadData thread_data[num_threads];
-    
-    for (int i = 0; i < num_threads; i++){
-        thread_data[i].thread_id = i;
-        thread_data[i].num_threads = num_threads;
-        thread_data[i].rows = rows;
-        thread_data[i].cols = cols;
-        thread_data[i].matrix = matrix;
-        thread_data[i].vec = vec;
-        thread_data[i].result = result;
-        
-        int rc = pthread_create(&threads[i], NULL, thread_multiply, (void*)&thread_data[i]);
-        if (rc){
-            cerr << "Error: Unable to create thread, " << rc << endl;
-            exit(-1);
-        }
-    }
-    
-    for (int i = 0; i < num_threads; i++){
-        pthread_join(threads[i], NULL);
-    }
-    
-    cout << "Result (size " << rows << "):" << endl << "{ ";
-    for (int i = 0; i < rows; i++){
-        cout << result[i] << " ";
-    }
-    cout << "}" << endl;
-    
-    for (int i = 0; i < rows; i++){
-        delete[] matrix[i];
-    }
-    delete[] matrix;
-    delete[] vec;
-    delete[] result;
-    
-    return 0;
-}
+#include <iostream>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <pthread.h>
+#include <unistd.h>
+#include "matvec_io.h"
+#include "sparse_matrix.h"
+using namespace std;
+
+// One multiplication handed to the pool: result = matrix * vec for all nvec
+// vectors. The buffers are untyped; `kernel` is the row-range worker for the
+// element type and storage (multiply_rows<T> or multiply_sparse_rows<T>), so
+// one pool serves every dtype.
+struct MultiplyJob {
+    int rows;
+    int cols;
+    const void *matrix; // rows x cols, row-major, or a SparseMatrix<T>
+    int nvec;
+    const void *vec;    // nvec x cols
+    void *result;       // rows x nvec accumulators
+    int chunk;          // rows claimed per grab, 0 for the default
+    void (*kernel)(const MultiplyJob &job, int start_row, int end_row);
+};
+
+template <typename T>
+void multiply_rows(const MultiplyJob &j, int start_row, int end_row) {
+    typedef typename Accumulator<T>::type Acc;
+    matmat_rows((const T*) j.matrix, j.cols, (const T*) j.vec, j.nvec,
+                (Acc*) j.result, start_row, end_row);
+}
+
+template <typename T>
+void multiply_sparse_rows(const MultiplyJob &j, int start_row, int end_row) {
+    typedef typename Accumulator<T>::type Acc;
+    sparse_matmat_rows(*(const SparseMatrix<T>*) j.matrix, (const T*) j.vec, j.nvec,
+                       (Acc*) j.result, start_row, end_row);
+}
+
+// Persistent worker pool. The threads are created once and reused by every
+// run(); rows are distributed dynamically in chunks through an atomic
+// counter, so no thread is stuck with a fixed (or leftover) share.
+class ThreadPool {
+public:
+    explicit ThreadPool(int num_threads)
+        : job(nullptr), generation(0), active(0), shutting_down(false), next_row(0) {
+        pthread_mutex_init(&mutex, NULL);
+        pthread_cond_init(&start_cond, NULL);
+        pthread_cond_init(&done_cond, NULL);
+        threads.resize(num_threads);
+        for (int i = 0; i < num_threads; i++){
+            int rc = pthread_create(&threads[i], NULL, worker_main, (void*)this);
+            if (rc){
+                cerr << "Error: Unable to create thread, " << rc << endl;
+                exit(-1);
+            }
+        }
+    }
+
+    ~ThreadPool() {
+        pthread_mutex_lock(&mutex);
+        shutting_down = true;
+        pthread_cond_broadcast(&start_cond);
+        pthread_mutex_unlock(&mutex);
+        for (size_t i = 0; i < threads.size(); i++){
+            pthread_join(threads[i], NULL);
+        }
+        pthread_cond_destroy(&done_cond);
+        pthread_cond_destroy(&start_cond);
+        pthread_mutex_destroy(&mutex);
+    }
+
+    int size() const { return (int) threads.size(); }
+
+    // Runs the job on all workers and returns once every row is done.
+    void run(const MultiplyJob &j) {
+        pthread_mutex_lock(&mutex);
+        job = &j;
+        next_row.store(0, memory_order_relaxed);
+        active = (int) threads.size();
+        generation++;
+        pthread_cond_broadcast(&start_cond);
+        while (active > 0)
+            pthread_cond_wait(&done_cond, &mutex);
+        job = nullptr;
+        pthread_mutex_unlock(&mutex);
+    }
+
+private:
+    static void* worker_main(void *arg) {
+        ((ThreadPool*) arg)->work();
+        return NULL;
+    }
+
+    void work() {
+        unsigned long seen = 0;
+        pthread_mutex_lock(&mutex);
+        while (true) {
+            while (!shutting_down && generation == seen)
+                pthread_cond_wait(&start_cond, &mutex);
+            if (shutting_down)
+                break;
+            seen = generation;
+            const MultiplyJob *j = job;
+            pthread_mutex_unlock(&mutex);
+
+            while (true) {
+                int start_row = next_row.fetch_add(j->chunk, memory_order_relaxed);
+                if (start_row >= j->rows)
+                    break;
+                int end_row = start_row + j->chunk < j->rows ? start_row + j->chunk : j->rows;
+                j->kernel(*j, start_row, end_row);
+            }
+
+            pthread_mutex_lock(&mutex);
+            if (--active == 0)
+                pthread_cond_signal(&done_cond);
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+
+    vector<pthread_t> threads;
+    pthread_mutex_t mutex;
+    pthread_cond_t start_cond;   // a new job was published (generation changed)
+    pthread_cond_t done_cond;    // the last worker finished the current job
+    const MultiplyJob *job;
+    unsigned long generation;
+    int active;
+    bool shutting_down;
+    atomic<int> next_row;
+};
+
+// Runs the job `repeat` times; chunks are rounded up to multiples of `granularity` rows.
+template <typename T>
+void run(ThreadPool &pool, MultiplyJob &job, int repeat, int granularity) {
+    typedef typename Accumulator<T>::type Acc;
+    // By default every thread gets about eight chunks to balance over, but
+    // at least 16 rows so the grabs stay cheap next to the work.
+    if (job.chunk == 0)
+        job.chunk = max(16, job.rows / (8 * pool.size()));
+    job.chunk = (job.chunk + granularity - 1) / granularity * granularity;
+    Acc *result = new Acc[(size_t)job.rows * job.nvec];
+    job.result = result;
+    for (int r = 0; r < repeat; r++){
+        pool.run(job);
+    }
+    
+    print_result(result, job.rows, job.nvec);
+    
+    delete[] result;
+}
+
+template <typename T>
+void run_dense(ThreadPool &pool, MultiplyJob &job, int repeat, const MatvecInput &in) {
+    job.rows = in.rows;
+    job.cols = in.cols;
+    job.matrix = in.matrix;
+    job.vec = in.vec;
+    job.kernel = multiply_rows<T>;
+    run<T>(pool, job, repeat, 1);
+}
+
+template <typename T>
+int run_sparse(ThreadPool &pool, MultiplyJob &job, int repeat, const SparseInput &in) {
+    SparseMatrix<T> matrix;
+    if (!load_sparse_matrix(in, matrix))
+        return 1;
+    job.rows = matrix.rows();
+    job.cols = matrix.cols();
+    job.matrix = &matrix;
+    job.vec = in.vec_file.data();
+    job.kernel = multiply_sparse_rows<T>;
+    run<T>(pool, job, repeat, SELL_CHUNK);  // keep SELL chunks whole
+    return 0;
+}
+
+// Checks the values of the optional flags, so a typo cannot quietly run a
+// different configuration. Prints an error and returns false on the first
+// invalid one.
+bool check_options(const char *threads_opt, const char *chunk_opt, const char *repeat_opt) {
+    if (threads_opt && atoi(threads_opt) < 1) {
+        cerr << "Error: --threads must be at least 1" << endl;
+        return false;
+    }
+    if (chunk_opt && atoi(chunk_opt) < 1) {
+        cerr << "Error: --chunk must be at least 1" << endl;
+        return false;
+    }
+    // Without a single run there would be no result to print.
+    if (repeat_opt && atoi(repeat_opt) < 1) {
+        cerr << "Error: --repeat must be at least 1" << endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]){
+    // Optional flags, removed from argv before the input is parsed.
+    const char *threads_opt = take_option(argc, argv, "--threads");
+    const char *chunk_opt = take_option(argc, argv, "--chunk");
+    const char *repeat_opt = take_option(argc, argv, "--repeat");
+    const char *format_opt = take_option(argc, argv, "--format");
+    const char *options = "Options: --threads <n> (default: all cores) --chunk <rows> --repeat <n> --format csr|sell";
+    if (!check_options(threads_opt, chunk_opt, repeat_opt)) {
+        cout << options << endl;
+        return 1;
+    }
+
+    bool sparse = is_sparse_input(argc, argv);
+    MatvecInput in;
+    SparseInput sin;
+    if (sparse ? !open_sparse_input(argv, format_opt, sin) : !load_input(argc, argv, in)) {
+        cout << options << endl;
+        return 1;
+    }
+    
+    int num_threads = threads_opt ? atoi(threads_opt) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    int repeat = repeat_opt ? atoi(repeat_opt) : 1;
+    
+    MultiplyJob job;
+    job.nvec = sparse ? sin.nvec : in.nvec;
+    job.chunk = chunk_opt ? atoi(chunk_opt) : 0;
+    
+    ThreadPool pool(num_threads);
+    if (sparse) {
+        switch (sin.dtype) {
+            case DTYPE_INT64:   return run_sparse<int64_t>(pool, job, repeat, sin);
+            case DTYPE_FLOAT32: return run_sparse<float>(pool, job, repeat, sin);
+            case DTYPE_FLOAT64: return run_sparse<double>(pool, job, repeat, sin);
+            default:            return run_sparse<int32_t>(pool, job, repeat, sin);
+        }
+    }
+    switch (in.dtype) {
+        case DTYPE_INT64:   run_dense<int64_t>(pool, job, repeat, in); break;
+        case DTYPE_FLOAT32: run_dense<float>(pool, job, repeat, in); break;
+        case DTYPE_FLOAT64: run_dense<double>(pool, job, repeat, in); break;
+        default:            run_dense<int32_t>(pool, job, repeat, in); break;
+    }
+    
+    return 0;
+}
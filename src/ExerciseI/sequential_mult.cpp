@@ -1,40 +1,74 @@
 #include <iostream>
 #include <cstdlib>
 #include <string>
+#include <vector>
+#include "matvec_io.h"
+#include "sparse_matrix.h"
 using namespace std;
 
-int main(int argc, char* argv[]){
-	int AN = atoi(argv[1]);
-	int AM = atoi(argv[2]);
+template <typename T>
+int run(const MatvecInput &in){
+	typedef typename Accumulator<T>::type Acc;
 
-	int i, j;
-	int A[AN][AM];
-	int v[AM];
-	
-	int arg_index = 3;
-	for (i = 0; i < AN; i++){
-		for (j = 0; j < AM; j++) {
-			A[i][j] = atoi(argv[arg_index++]);
-		}
-	}
-	for (i = 0; i < AM; i++){ 
-		v[i] = atoi(argv[arg_index++]);
-	}
+	int AN = in.rows;
+	int AM = in.cols;
+	int K = in.nvec;
+	const T *A = (const T*) in.matrix;
+	const T *v = (const T*) in.vec;
 
-	int Ax[AN] = {0};
+	// One pass over A for all K vectors (K = 1 is the plain product).
+	vector<Acc> Ax((size_t)AN * K, 0);
 	
-	for (i = 0; i < AN; i++){
-		for (j = 0; j < AM; j++) {
-			Ax[i] += A[i][j] * v[j];
+	matmat_rows(A, AM, v, K, Ax.data(), 0, AN);
+
+	print_result(Ax.data(), AN, K);
+
+	return 0;
+}
+
+template <typename T>
+int run_sparse(const SparseInput &in){
+	typedef typename Accumulator<T>::type Acc;
+
+	SparseMatrix<T> A;
+	if (!load_sparse_matrix(in, A))
+		return 1;
+	int AN = A.rows();
+	int K = in.nvec;
+	const T *v = (const T*) in.vec_file.data();
+
+	// Work proportional to the nonzeros, for all K vectors.
+	vector<Acc> Ax((size_t)AN * K, 0);
+
+	sparse_matmat_rows(A, v, K, Ax.data(), 0, AN);
+
+	print_result(Ax.data(), AN, K);
+
+	return 0;
+}
+
+int main(int argc, char* argv[]){
+	const char *format_opt = take_option(argc, argv, "--format");
+	if (is_sparse_input(argc, argv)) {
+		SparseInput sin;
+		if (!open_sparse_input(argv, format_opt, sin))
+			return 1;
+		switch (sin.dtype) {
+			case DTYPE_INT64:   return run_sparse<int64_t>(sin);
+			case DTYPE_FLOAT32: return run_sparse<float>(sin);
+			case DTYPE_FLOAT64: return run_sparse<double>(sin);
+			default:            return run_sparse<int32_t>(sin);
 		}
 	}
 
-	cout << "Result (size " << AN << "):" << endl
-	     << "{ ";
-	for (i = 0; i < AN; i++){
-		cout << Ax[i] << " ";
-	}
-	cout << "}" << endl;
+	MatvecInput in;
+	if (!load_input(argc, argv, in))
+		return 1;
 
-	return 0;
+	switch (in.dtype) {
+		case DTYPE_INT64:   return run<int64_t>(in);
+		case DTYPE_FLOAT32: return run<float>(in);
+		case DTYPE_FLOAT64: return run<double>(in);
+		default:            return run<int32_t>(in);
+	}
 }
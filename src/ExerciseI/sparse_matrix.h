@@ -0,0 +1,377 @@
+#ifndef SPARSE_MATRIX_H
+#define SPARSE_MATRIX_H
+
+// Sparse matrix input and kernels for the ExerciseI programs.
+//
+// "--mtx <matrix.mtx> <vector file>" reads the matrix from a Matrix Market
+// coordinate file and the vectors from a binary file (see matvec_io.h), whose
+// dtype also decides the element type the matrix values are converted to.
+// The matrix is kept in CSR, or optionally in SELL-C-sigma (--format sell),
+// so memory and work are proportional to the number of nonzeros.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "matvec_io.h"
+
+// Compressed sparse rows: the nonzeros of row i are
+// values[row_ptr[i] .. row_ptr[i+1]) at columns col_idx[...].
+template <typename T>
+struct CsrMatrix {
+    int rows = 0, cols = 0;
+    int64_t nnz = 0;
+    AlignedArray<int64_t> row_ptr;  // rows + 1
+    AlignedArray<int> col_idx;      // nnz
+    AlignedArray<T> values;         // nnz
+};
+
+// SELL-C-sigma: rows are sorted by length inside windows of SELL_SIGMA rows
+// and packed in chunks of SELL_CHUNK rows, each chunk stored column-major and
+// padded to its longest row. The SELL_CHUNK rows of a chunk are processed in
+// lockstep, which the compiler turns into SIMD over rows.
+const int SELL_CHUNK = 8;
+const int SELL_SIGMA = 256;
+
+template <typename T>
+struct SellMatrix {
+    int rows = 0, cols = 0;
+    int nchunks = 0;
+    AlignedArray<int64_t> chunk_ptr; // nchunks + 1, in elements
+    AlignedArray<int> chunk_len;     // nchunks, longest row of each chunk
+    AlignedArray<int> col_idx;       // padding entries point at column 0
+    AlignedArray<T> values;          // padding entries are 0
+    AlignedArray<int> perm;          // sorted position -> original row
+};
+
+enum SparseFormat { FORMAT_CSR, FORMAT_SELL };
+
+template <typename T>
+struct SparseMatrix {
+    SparseFormat format = FORMAT_CSR;
+    CsrMatrix<T> csr;
+    SellMatrix<T> sell;
+
+    int rows() const { return csr.rows; }
+    int cols() const { return csr.cols; }
+};
+
+// Header of a Matrix Market file, e.g.
+//   %%MatrixMarket matrix coordinate real general
+struct MatrixMarketInfo {
+    int rows = 0, cols = 0;
+    int64_t entries = 0;
+    bool integer = false;   // "integer" field, parsed exactly
+    bool pattern = false;   // "pattern" field, every value is 1
+    bool symmetric = false; // "symmetric" or "skew-symmetric": lower triangle only
+    bool skew = false;
+};
+
+inline bool read_matrix_market_header(FILE *f, const char *path, MatrixMarketInfo &info) {
+    char line[1024], object[64], format[64], field[64], symmetry[64];
+    if (!fgets(line, sizeof(line), f) ||
+        sscanf(line, "%%%%MatrixMarket %63s %63s %63s %63s", object, format, field, symmetry) != 4) {
+        std::cerr << "Error: " << path << " is not a Matrix Market file" << std::endl;
+        return false;
+    }
+    if (strcmp(object, "matrix") != 0 || strcmp(format, "coordinate") != 0 ||
+        strcmp(field, "complex") == 0 || strcmp(symmetry, "hermitian") == 0) {
+        std::cerr << "Error: " << path << ": only real/integer/pattern coordinate matrices are supported" << std::endl;
+        return false;
+    }
+    info.integer = strcmp(field, "integer") == 0;
+    info.pattern = strcmp(field, "pattern") == 0;
+    info.skew = strcmp(symmetry, "skew-symmetric") == 0;
+    info.symmetric = info.skew || strcmp(symmetry, "symmetric") == 0;
+
+    // Skip comments up to the size line.
+    long long entries;
+    do {
+        if (!fgets(line, sizeof(line), f)) {
+            std::cerr << "Error: " << path << " has no size line" << std::endl;
+            return false;
+        }
+    } while (line[0] == '%');
+    if (sscanf(line, "%d %d %lld", &info.rows, &info.cols, &entries) != 3 ||
+        info.rows < 0 || info.cols < 0 || entries < 0) {
+        std::cerr << "Error: " << path << " has an invalid size line" << std::endl;
+        return false;
+    }
+    info.entries = entries;
+    return true;
+}
+
+// Reads only the header, e.g. to learn the size before loading a window.
+inline bool read_matrix_market_info(const char *path, MatrixMarketInfo &info) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        std::cerr << "Error: cannot open " << path << std::endl;
+        return false;
+    }
+    bool ok = read_matrix_market_header(f, path, info);
+    fclose(f);
+    return ok;
+}
+
+// Reads the entries of a Matrix Market file that fall in the window
+// [row_begin, row_begin+row_count) x [col_begin, col_begin+col_count) into a
+// CSR matrix of that window (column indices relative to col_begin). A
+// row_count of -1 loads the whole matrix. Symmetric files are expanded.
+template <typename T>
+bool load_matrix_market(const char *path, int row_begin, int row_count,
+                        int col_begin, int col_count, CsrMatrix<T> &m) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        std::cerr << "Error: cannot open " << path << std::endl;
+        return false;
+    }
+    MatrixMarketInfo info;
+    if (!read_matrix_market_header(f, path, info)) {
+        fclose(f);
+        return false;
+    }
+    if (row_count < 0) {
+        row_count = info.rows - row_begin;
+        col_count = info.cols - col_begin;
+    }
+
+    // Coordinates kept by this window, in file order.
+    std::vector<int> coo_row, coo_col;
+    std::vector<T> coo_val;
+    auto keep = [&](int i, int j, T v) {
+        if (i >= row_begin && i < row_begin + row_count &&
+            j >= col_begin && j < col_begin + col_count) {
+            coo_row.push_back(i - row_begin);
+            coo_col.push_back(j - col_begin);
+            coo_val.push_back(v);
+        }
+    };
+
+    char line[1024];
+    int64_t read = 0;
+    while (read < info.entries && fgets(line, sizeof(line), f)) {
+        if (line[0] == '%' || line[0] == '\n')
+            continue;
+        char *p = line, *end;
+        long i = strtol(p, &end, 10);
+        if (end == p)
+            break;
+        p = end;
+        long j = strtol(p, &end, 10);
+        if (end == p)
+            break;
+        p = end;
+        T v = 1;
+        if (info.integer) {
+            v = (T) strtoll(p, &end, 10);
+        } else if (!info.pattern) {
+            v = (T) strtod(p, &end);
+        }
+        if ((!info.pattern && end == p) || i < 1 || i > info.rows || j < 1 || j > info.cols)
+            break;
+        read++;
+        // Matrix Market indices are 1-based.
+        keep((int) i - 1, (int) j - 1, v);
+        if (info.symmetric && i != j)
+            keep((int) j - 1, (int) i - 1, info.skew ? (T) -v : v);
+    }
+    fclose(f);
+    if (read != info.entries) {
+        std::cerr << "Error: " << path << ": bad or missing entry " << read + 1 << std::endl;
+        return false;
+    }
+
+    // Counting sort by row; the file order is kept within each row.
+    m.rows = row_count;
+    m.cols = col_count;
+    m.nnz = (int64_t) coo_val.size();
+    m.row_ptr.allocate((size_t) row_count + 1);
+    m.col_idx.allocate((size_t) m.nnz);
+    m.values.allocate((size_t) m.nnz);
+    for (int i = 0; i <= row_count; i++)
+        m.row_ptr[i] = 0;
+    for (size_t e = 0; e < coo_row.size(); e++)
+        m.row_ptr[coo_row[e] + 1]++;
+    for (int i = 0; i < row_count; i++)
+        m.row_ptr[i + 1] += m.row_ptr[i];
+    std::vector<int64_t> next(m.row_ptr.data(), m.row_ptr.data() + row_count);
+    for (size_t e = 0; e < coo_row.size(); e++) {
+        int64_t dst = next[coo_row[e]]++;
+        m.col_idx[dst] = coo_col[e];
+        m.values[dst] = coo_val[e];
+    }
+    return true;
+}
+
+// Builds the SELL-C-sigma copy of a CSR matrix.
+template <typename T>
+void csr_to_sell(const CsrMatrix<T> &a, SellMatrix<T> &s) {
+    s.rows = a.rows;
+    s.cols = a.cols;
+    s.nchunks = (a.rows + SELL_CHUNK - 1) / SELL_CHUNK;
+
+    // Sort by descending length inside each sigma window, so rows of similar
+    // length share a chunk and little padding is needed.
+    s.perm.allocate((size_t) s.nchunks * SELL_CHUNK);
+    for (int i = 0; i < a.rows; i++)
+        s.perm[i] = i;
+    auto row_len = [&](int i) { return a.row_ptr[i + 1] - a.row_ptr[i]; };
+    for (int w = 0; w < a.rows; w += SELL_SIGMA) {
+        int w_end = std::min(w + SELL_SIGMA, a.rows);
+        std::stable_sort(s.perm.data() + w, s.perm.data() + w_end,
+                         [&](int x, int y) { return row_len(x) > row_len(y); });
+    }
+    // Padding rows of the last chunk are empty.
+    for (int i = a.rows; i < s.nchunks * SELL_CHUNK; i++)
+        s.perm[i] = -1;
+
+    s.chunk_ptr.allocate((size_t) s.nchunks + 1);
+    s.chunk_len.allocate((size_t) s.nchunks);
+    s.chunk_ptr[0] = 0;
+    for (int c = 0; c < s.nchunks; c++) {
+        int64_t len = 0;
+        for (int r = 0; r < SELL_CHUNK; r++) {
+            int i = s.perm[c * SELL_CHUNK + r];
+            if (i >= 0)
+                len = std::max(len, row_len(i));
+        }
+        s.chunk_len[c] = (int) len;
+        s.chunk_ptr[c + 1] = s.chunk_ptr[c] + len * SELL_CHUNK;
+    }
+
+    int64_t total = s.chunk_ptr[s.nchunks];
+    s.col_idx.allocate((size_t) total);
+    s.values.allocate((size_t) total);
+    for (int c = 0; c < s.nchunks; c++) {
+        for (int r = 0; r < SELL_CHUNK; r++) {
+            int i = s.perm[c * SELL_CHUNK + r];
+            int64_t len = i >= 0 ? row_len(i) : 0;
+            for (int64_t j = 0; j < s.chunk_len[c]; j++) {
+                int64_t dst = s.chunk_ptr[c] + j * SELL_CHUNK + r;
+                if (j < len) {
+                    s.col_idx[dst] = a.col_idx[a.row_ptr[i] + j];
+                    s.values[dst] = a.values[a.row_ptr[i] + j];
+                } else {
+                    s.col_idx[dst] = 0;
+                    s.values[dst] = 0;
+                }
+            }
+        }
+    }
+}
+
+// Y[i][k] = A[i][:] . V[k][:] for row_begin <= i < row_end, with the same
+// V (nvec x cols) and Y (rows x nvec) layouts as matmat_rows().
+template <typename T>
+void csr_matmat_rows(const CsrMatrix<T> &a, const T *V, size_t nvec,
+                     typename Accumulator<T>::type *Y, size_t row_begin, size_t row_end) {
+    typedef typename Accumulator<T>::type Acc;
+    for (size_t i = row_begin; i < row_end; i++) {
+        int64_t begin = a.row_ptr[i], end = a.row_ptr[i + 1];
+        for (size_t k = 0; k < nvec; k++) {
+            const T *v = V + k * a.cols;
+            Acc temp = 0;
+            for (int64_t e = begin; e < end; e++)
+                temp += (Acc) a.values[e] * v[a.col_idx[e]];
+            Y[i * nvec + k] = temp;
+        }
+    }
+}
+
+// Same product for SELL-C-sigma. The range is in sorted row order, so callers
+// split [0, rows) as usual and every result still lands in its original row;
+// ranges aligned to SELL_CHUNK avoid recomputing shared chunks.
+template <typename T>
+void sell_matmat_rows(const SellMatrix<T> &s, const T *V, size_t nvec,
+                      typename Accumulator<T>::type *Y, size_t row_begin, size_t row_end) {
+    typedef typename Accumulator<T>::type Acc;
+    if (row_begin >= row_end)
+        return;
+    for (size_t c = row_begin / SELL_CHUNK; c <= (row_end - 1) / SELL_CHUNK; c++) {
+        const int *col = s.col_idx.data() + s.chunk_ptr[c];
+        const T *val = s.values.data() + s.chunk_ptr[c];
+        int len = s.chunk_len[c];
+        for (size_t k = 0; k < nvec; k++) {
+            const T *v = V + k * s.cols;
+            Acc temp[SELL_CHUNK] = {0};
+            for (int j = 0; j < len; j++) {
+                for (int r = 0; r < SELL_CHUNK; r++)
+                    temp[r] += (Acc) val[j * SELL_CHUNK + r] * v[col[j * SELL_CHUNK + r]];
+            }
+            for (int r = 0; r < SELL_CHUNK; r++) {
+                size_t pos = c * SELL_CHUNK + r;
+                if (pos >= row_begin && pos < row_end && s.perm[pos] >= 0)
+                    Y[(size_t) s.perm[pos] * nvec + k] = temp[r];
+            }
+        }
+    }
+}
+
+template <typename T>
+inline void sparse_matmat_rows(const SparseMatrix<T> &a, const T *V, size_t nvec,
+                               typename Accumulator<T>::type *Y, size_t row_begin, size_t row_end) {
+    if (a.format == FORMAT_SELL)
+        sell_matmat_rows(a.sell, V, nvec, Y, row_begin, row_end);
+    else
+        csr_matmat_rows(a.csr, V, nvec, Y, row_begin, row_end);
+}
+
+// Sparse counterpart of MatvecInput: the vectors are mapped from their binary
+// file, the matrix is parsed once the element type is known (load_sparse_matrix).
+struct SparseInput {
+    const char *matrix_path = nullptr;
+    SparseFormat format = FORMAT_CSR;
+    uint32_t dtype = DTYPE_INT32;
+    int nvec = 1;
+    MatrixFile vec_file;
+};
+
+// True when the command line asks for "--mtx <matrix.mtx> <vector file>".
+inline bool is_sparse_input(int argc, char* argv[]) {
+    return argc >= 4 && strcmp(argv[1], "--mtx") == 0;
+}
+
+// Opens the vector file and records the matrix path and storage format
+// ("csr" or "sell", nullptr for the default).
+inline bool open_sparse_input(char* argv[], const char *format_opt, SparseInput &in) {
+    if (format_opt && strcmp(format_opt, "sell") == 0) {
+        in.format = FORMAT_SELL;
+    } else if (format_opt && strcmp(format_opt, "csr") != 0) {
+        std::cerr << "Error: --format must be csr or sell" << std::endl;
+        return false;
+    }
+    in.matrix_path = argv[2];
+    if (!in.vec_file.open(argv[3]))
+        return false;
+    in.dtype = in.vec_file.dtype();
+    in.nvec = (int) in.vec_file.rows();
+    if (in.nvec < 1) {
+        std::cerr << "Error: vector file has no vectors" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Loads the whole matrix in the requested format and checks it against the vectors.
+template <typename T>
+bool load_sparse_matrix(const SparseInput &in, SparseMatrix<T> &a) {
+    if (!load_matrix_market(in.matrix_path, 0, -1, 0, -1, a.csr))
+        return false;
+    if (in.vec_file.cols() != (uint64_t) a.cols()) {
+        std::cerr << "Error: vector file must be K x " << a.cols() << std::endl;
+        return false;
+    }
+    a.format = in.format;
+    if (a.format == FORMAT_SELL) {
+        csr_to_sell(a.csr, a.sell);
+        // Only the sizes of the CSR copy are still needed.
+        a.csr.col_idx = AlignedArray<int>();
+        a.csr.values = AlignedArray<T>();
+    }
+    return true;
+}
+
+#endif
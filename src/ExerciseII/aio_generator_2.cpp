@@ -28,6 +28,11 @@ int main(int argc, char* argv[]){
 	} else if (strcmp(funct_to_run, "mpi") == 0) {
 		run = "./run_mpi";
 		cmd << "mpirun -n " << nthreads << " " << run << " " << rows << " " << cols;
+	} else if (strcmp(funct_to_run, "hybrid") == 0) {
+		// nthreads threads in each of the ranks given as the 5th argument (1 by default).
+		int nranks = argc > 5 ? atoi(argv[5]) : 1;
+		run = "./run_hybrid";
+		cmd << "mpirun -n " << nranks << " " << run << " " << rows << " " << cols << " " << nthreads;
 	}
 
 	cout << "Hot Plate (" << rows << "x" << cols << ")" << endl << endl;
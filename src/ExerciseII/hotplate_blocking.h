@@ -0,0 +1,83 @@
+#ifndef HOTPLATE_BLOCKING_H
+#define HOTPLATE_BLOCKING_H
+
+// Temporal blocking for the hotplate sweeps.
+//
+// A plain sweep streams the whole plate through the caches once per time step.
+// Here the rows are cut into tiles small enough that both buffers of a tile
+// stay in L2, and each tile is advanced several steps before moving on:
+//
+//   1. every tile runs steps 1..T over a trapezoid that loses one row per step
+//      at each edge it shares with another tile (a row can only be advanced
+//      once its neighbours are at the previous step);
+//   2. the rows left out around each seam between two tiles, a triangle that
+//      grows by one row per step on each side, are then advanced with the
+//      rows phase 1 produced on both sides.
+//
+// The tiles of a phase are independent, so each phase can run in parallel.
+// The two buffers are used exactly as by plain sweeps (step s is written into
+// the buffer of parity s) and every cell goes through the same row kernel, so
+// the plate after a block is bit-identical to T calls of sweep_rows().
+//
+// Tiles are at least 2T rows, which keeps the trapezoids non-empty and the
+// seam triangles apart. No step overwrites a row that is still needed:
+//   - a trapezoid writes step t over step t-2 only in rows the seam
+//     triangle's step t-1 does not read;
+//   - a triangle step overwrites values that only its own earlier step read.
+
+#include <algorithm>
+#include <unistd.h>
+
+#include "hotplate_grid.h"
+
+// Bytes of cache one tile may use, for both buffers: half of L2, so the rows
+// the tile reads from its neighbours and the stack still fit.
+inline size_t time_block_cache_bytes() {
+    long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    return (l2 > 0 ? (size_t) l2 : (size_t) 1 << 20) / 2;
+}
+
+// Tiling of rows [row_begin, row_end) for blocks of `steps` sweeps.
+struct TimeBlockPlan {
+    int row_begin, row_end;
+    int tile_rows;
+    int ntiles;
+    int steps;
+
+    int tile_begin(int k) const { return row_begin + k * tile_rows; }
+    // The last tile takes the remainder, so no tile is shorter than tile_rows.
+    int tile_end(int k) const { return k == ntiles - 1 ? row_end : row_begin + (k + 1) * tile_rows; }
+};
+
+inline TimeBlockPlan plan_time_block(const PlateGrid &grid, int row_begin, int row_end, int steps) {
+    TimeBlockPlan plan;
+    plan.row_begin = row_begin;
+    plan.row_end = row_end;
+    plan.steps = steps;
+    int fit = (int) (time_block_cache_bytes() / (2 * grid.stride() * sizeof(float)));
+    plan.tile_rows = std::max(fit, 2 * steps);
+    plan.ntiles = std::max(1, (row_end - row_begin) / plan.tile_rows);
+    return plan;
+}
+
+// Phase 1 for tile k: sweeps first+1 .. first+steps, where sweep s reads
+// grids[(s-1) % 2] and writes grids[s % 2].
+inline void time_block_tile(const FixedCells &fixed, PlateGrid *const grids[2], long first,
+                            const TimeBlockPlan &plan, int k) {
+    int tb = plan.tile_begin(k), te = plan.tile_end(k);
+    for (int t = 1; t <= plan.steps; t++) {
+        int lo = k == 0 ? tb : tb + t - 1;
+        int hi = k == plan.ntiles - 1 ? te : te - t + 1;
+        sweep_rows(fixed, *grids[(first + t - 1) % 2], *grids[(first + t) % 2], lo, hi, false);
+    }
+}
+
+// Phase 2 for the seam at the top of tile k (1 <= k < ntiles).
+inline void time_block_seam(const FixedCells &fixed, PlateGrid *const grids[2], long first,
+                            const TimeBlockPlan &plan, int k) {
+    int e = plan.tile_begin(k);
+    for (int t = 2; t <= plan.steps; t++)
+        sweep_rows(fixed, *grids[(first + t - 1) % 2], *grids[(first + t) % 2], e - t + 1, e + t - 1, false);
+}
+
+#endif
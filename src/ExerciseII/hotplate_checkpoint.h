@@ -0,0 +1,201 @@
+#ifndef HOTPLATE_CHECKPOINT_H
+#define HOTPLATE_CHECKPOINT_H
+
+// Checkpoints of a running hotplate solve, and --restart from them.
+//
+// A checkpoint file is a 64-byte header followed by the whole plate, rows x
+// cols floats, row-major without padding. The header records the sweep (the
+// cycle, for multigrid) the plate is at and the state of the convergence
+// schedule, so a restarted run makes the same decisions as one that was
+// never stopped and ends with the same result.
+//
+// Checkpoints are written to "<path>.tmp" and renamed over <path> once
+// complete, so <path> always holds the latest complete one. The sweeps only
+// pause while the plate is copied into a staging buffer; a background thread
+// maps the file and writes the copy out while the solver carries on. The
+// next checkpoint first waits for that write to finish. The MPI versions
+// write the same file with MPI-IO (hotplate_checkpoint_mpi.h).
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hotplate_grid.h"
+#include "hotplate_options.h"
+
+static const char CHECKPOINT_MAGIC[8] = {'H', 'P', 'C', 'K', 'P', 'T', '0', '1'};
+
+struct CheckpointHeader {
+    char magic[8];         // CHECKPOINT_MAGIC
+    int32_t rows, cols;
+    int32_t solver;        // HotplateSolver
+    int32_t reserved0;
+    int64_t sweep;         // sweeps (cycles) done
+    int64_t next_check;    // ConvergenceSchedule state
+    int64_t last_sweep;
+    float last_residual;
+    uint8_t reserved[12];
+};
+static_assert(sizeof(CheckpointHeader) == 64, "checkpoint header must stay 64 bytes");
+
+inline CheckpointHeader make_checkpoint_header(int rows, int cols, int solver, long sweep,
+                                               const ConvergenceSchedule &schedule) {
+    CheckpointHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CHECKPOINT_MAGIC, sizeof(h.magic));
+    h.rows = rows;
+    h.cols = cols;
+    h.solver = solver;
+    h.sweep = sweep;
+    h.next_check = schedule.next_due();
+    h.last_sweep = schedule.last_checked();
+    h.last_residual = schedule.last_checked_residual();
+    return h;
+}
+
+// Checks that a checkpoint belongs to this run. Prints an error otherwise.
+inline bool check_checkpoint_header(const CheckpointHeader &h, const char *path, int rows, int cols, int solver) {
+    if (memcmp(h.magic, CHECKPOINT_MAGIC, sizeof(h.magic)) != 0) {
+        std::cerr << "Error: " << path << " is not a hotplate checkpoint" << std::endl;
+        return false;
+    }
+    if (h.rows != rows || h.cols != cols || h.solver != solver) {
+        std::cerr << "Error: " << path << " is a checkpoint of another plate size or solver" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Plate and schedule from the checkpoint at path, into every grid in
+// grids[0 .. ngrids). Returns the sweep it was taken at, or -1 after
+// printing an error.
+inline long load_checkpoint(const char *path, int rows, int cols, int solver, PlateGrid* const grids[], int ngrids,
+                            ConvergenceSchedule &schedule) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Error: cannot open checkpoint " << path << std::endl;
+        return -1;
+    }
+    size_t length = sizeof(CheckpointHeader) + (size_t) rows * cols * sizeof(float);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(CheckpointHeader)) {
+        std::cerr << "Error: " << path << " is not a hotplate checkpoint" << std::endl;
+        close(fd);
+        return -1;
+    }
+    void *base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        std::cerr << "Error: cannot map " << path << std::endl;
+        return -1;
+    }
+    const CheckpointHeader &h = *(const CheckpointHeader*) base;
+    long sweep = -1;
+    if (check_checkpoint_header(h, path, rows, cols, solver)) {
+        if ((size_t) st.st_size < length) {
+            std::cerr << "Error: " << path << " is truncated" << std::endl;
+        } else {
+            const float *plate = (const float*) ((const char*) base + sizeof(CheckpointHeader));
+            for (int g = 0; g < ngrids; g++)
+                for (int i = 0; i < rows; i++)
+                    memcpy(grids[g]->row(i), plate + (size_t) i * cols, cols * sizeof(float));
+            schedule.resume(h.next_check, h.last_sweep, h.last_residual);
+            sweep = h.sweep;
+        }
+    }
+    munmap(base, st.st_size);
+    return sweep;
+}
+
+// Writes rows x cols plates, one checkpoint at a time, in the background.
+class CheckpointWriter {
+public:
+    // A writer with opt.checkpoint_every == 0 never takes checkpoints.
+    // first_sweep is the sweep the run starts from.
+    CheckpointWriter(const HotplateOptions &opt, int rows, int cols, long first_sweep)
+        : path(opt.checkpoint_path), every(opt.checkpoint_every), saved(first_sweep),
+          rows(rows), cols(cols), solver(opt.solver) {
+        if (every > 0)
+            staging.resize((size_t) rows * cols);
+    }
+    ~CheckpointWriter() { wait(); }
+    CheckpointWriter(const CheckpointWriter&) = delete;
+    CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+    // Whether a checkpoint is due after sweep: the first sweep a solver
+    // offers once a multiple of the interval has passed since the last one.
+    bool due(long sweep) const { return every > 0 && sweep / every > saved / every; }
+
+    // Starts the checkpoint of sweep: waits for the previous write, so the
+    // staging buffer is free, and records the header. Called by one thread.
+    void begin(long sweep, const ConvergenceSchedule &schedule) {
+        wait();
+        header = make_checkpoint_header(rows, cols, solver, sweep, schedule);
+        saved = sweep;
+    }
+
+    // Copies rows [row_begin, row_end) of the plate into the staging buffer.
+    // Threads may stage disjoint rows at the same time.
+    void stage_rows(const PlateGrid &grid, int row_begin, int row_end) {
+        for (int i = row_begin; i < row_end; i++)
+            memcpy(&staging[(size_t) i * cols], grid.row(i), cols * sizeof(float));
+    }
+
+    // Writes the staged plate out in the background. Called by one thread.
+    void commit() { worker = std::thread(&CheckpointWriter::write_file, this); }
+
+    // begin(), stage_rows() of the whole plate and commit() from one thread.
+    void save(long sweep, const ConvergenceSchedule &schedule, const PlateGrid &grid) {
+        begin(sweep, schedule);
+        stage_rows(grid, 0, rows);
+        commit();
+    }
+
+    // Waits for the pending write, if any.
+    void wait() {
+        if (worker.joinable())
+            worker.join();
+    }
+
+private:
+    std::string path;
+    long every, saved;
+    int rows, cols, solver;
+    CheckpointHeader header;
+    std::vector<float> staging;
+    std::thread worker;
+
+    void write_file() {
+        std::string tmp = path + ".tmp";
+        size_t length = sizeof(CheckpointHeader) + staging.size() * sizeof(float);
+        int fd = open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || ftruncate(fd, length) != 0) {
+            std::cerr << "Warning: cannot write checkpoint " << tmp << std::endl;
+            if (fd >= 0)
+                close(fd);
+            return;
+        }
+        void *base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) {
+            std::cerr << "Warning: cannot map checkpoint " << tmp << std::endl;
+            return;
+        }
+        memcpy(base, &header, sizeof(header));
+        memcpy((char*) base + sizeof(header), staging.data(), staging.size() * sizeof(float));
+        bool ok = msync(base, length, MS_SYNC) == 0;
+        munmap(base, length);
+        if (!ok || rename(tmp.c_str(), path.c_str()) != 0)
+            std::cerr << "Warning: cannot write checkpoint " << path << std::endl;
+    }
+};
+
+#endif
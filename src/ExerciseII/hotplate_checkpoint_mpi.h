@@ -0,0 +1,179 @@
+#ifndef HOTPLATE_CHECKPOINT_MPI_H
+#define HOTPLATE_CHECKPOINT_MPI_H
+
+// Checkpoints of the MPI and hybrid versions, in the file format of
+// hotplate_checkpoint.h, so any version can restart from them.
+//
+// Every rank writes its block straight into the plate in the file with
+// MPI-IO: a subarray file view places the block, and the blocks along the
+// plate's edge also write the border cells held in their ghost cells. The
+// write is a nonblocking collective (MPI_File_iwrite_all) from a staging
+// copy of the block; the ranks go on sweeping and the next checkpoint, or
+// the end of the run, waits for it before the file is renamed into place.
+
+#include <mpi.h>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "hotplate_checkpoint.h"
+#include "hotplate_grid.h"
+#include "hotplate_halo.h"
+#include "hotplate_options.h"
+
+// Cells of the plate held by a rank (block_plate_cells()), and the file type
+// that places them in the global plate.
+struct BlockRegion {
+    int row_begin, row_end, col_begin, col_end;
+    MPI_Datatype filetype;
+};
+
+inline BlockRegion block_region(const LocalBlock &block, int global_rows, int global_cols) {
+    BlockRegion reg;
+    block_plate_cells(block, reg.row_begin, reg.row_end, reg.col_begin, reg.col_end);
+    int sizes[2] = {global_rows, global_cols};
+    int subsizes[2] = {reg.row_end - reg.row_begin, reg.col_end - reg.col_begin};
+    int starts[2] = {block.row_offset + reg.row_begin, block.col_offset + reg.col_begin};
+    MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, MPI_FLOAT, &reg.filetype);
+    MPI_Type_commit(&reg.filetype);
+    return reg;
+}
+
+// Plate and schedule from the checkpoint at path into every grid in
+// grids[0 .. ngrids), this rank's region of it. Collective over block.comm;
+// returns the sweep the checkpoint was taken at on every rank, or -1 after
+// rank 0 printed an error.
+inline long load_block_checkpoint(const char *path, int global_rows, int global_cols, int solver,
+                                  const LocalBlock &block, PlateGrid* const grids[], int ngrids,
+                                  ConvergenceSchedule &schedule) {
+    int rank;
+    MPI_Comm_rank(block.comm, &rank);
+    MPI_File fh;
+    if (MPI_File_open(block.comm, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        if (rank == 0)
+            std::cerr << "Error: cannot open checkpoint " << path << std::endl;
+        return -1;
+    }
+    // Rank 0 checks the header and tells the others.
+    CheckpointHeader h;
+    MPI_Offset size;
+    MPI_File_get_size(fh, &size);
+    int ok = 0;
+    if (rank == 0 && size >= (MPI_Offset) sizeof(h)) {
+        MPI_File_read_at(fh, 0, &h, sizeof(h), MPI_BYTE, MPI_STATUS_IGNORE);
+        ok = check_checkpoint_header(h, path, global_rows, global_cols, solver);
+        if (ok && size < (MPI_Offset) (sizeof(h) + (size_t) global_rows * global_cols * sizeof(float))) {
+            std::cerr << "Error: " << path << " is truncated" << std::endl;
+            ok = 0;
+        }
+    } else if (rank == 0) {
+        std::cerr << "Error: " << path << " is not a hotplate checkpoint" << std::endl;
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, block.comm);
+    if (!ok) {
+        MPI_File_close(&fh);
+        return -1;
+    }
+    MPI_Bcast(&h, sizeof(h), MPI_BYTE, 0, block.comm);
+
+    BlockRegion reg = block_region(block, global_rows, global_cols);
+    int width = reg.col_end - reg.col_begin;
+    std::vector<float> cells((size_t) (reg.row_end - reg.row_begin) * width);
+    MPI_File_set_view(fh, sizeof(CheckpointHeader), MPI_FLOAT, reg.filetype, "native", MPI_INFO_NULL);
+    MPI_File_read_all(fh, cells.data(), (int) cells.size(), MPI_FLOAT, MPI_STATUS_IGNORE);
+    MPI_File_close(&fh);
+    MPI_Type_free(&reg.filetype);
+
+    for (int g = 0; g < ngrids; g++)
+        for (int i = reg.row_begin; i < reg.row_end; i++)
+            memcpy(&(*grids[g])(i, reg.col_begin), &cells[(size_t) (i - reg.row_begin) * width],
+                   width * sizeof(float));
+    schedule.resume(h.next_check, h.last_sweep, h.last_residual);
+    return h.sweep;
+}
+
+// Writes this rank's region of the plate, one checkpoint at a time, in the
+// background. All calls are collective over block.comm and, in the hybrid
+// version, made by the master thread. finish() must be called before
+// MPI_Finalize.
+class BlockCheckpointWriter {
+public:
+    // A writer with opt.checkpoint_every == 0 never takes checkpoints.
+    // first_sweep is the sweep the run starts from.
+    BlockCheckpointWriter(const HotplateOptions &opt, int global_rows, int global_cols, const LocalBlock &block,
+                          long first_sweep)
+        : path(opt.checkpoint_path), every(opt.checkpoint_every), saved(first_sweep),
+          rows(global_rows), cols(global_cols), solver(opt.solver), comm(block.comm), pending(false) {
+        if (every > 0) {
+            reg = block_region(block, global_rows, global_cols);
+            staging.resize((size_t) (reg.row_end - reg.row_begin) * (reg.col_end - reg.col_begin));
+        }
+    }
+    BlockCheckpointWriter(const BlockCheckpointWriter&) = delete;
+    BlockCheckpointWriter& operator=(const BlockCheckpointWriter&) = delete;
+
+    // Whether a checkpoint is due after sweep; see CheckpointWriter::due().
+    bool due(long sweep) const { return every > 0 && sweep / every > saved / every; }
+
+    // Checkpoint of grid after sweep: waits for the previous one, copies the
+    // region to the staging buffer and starts writing it.
+    void save(long sweep, const ConvergenceSchedule &schedule, const PlateGrid &grid) {
+        wait();
+        saved = sweep;
+        int width = reg.col_end - reg.col_begin;
+        for (int i = reg.row_begin; i < reg.row_end; i++)
+            memcpy(&staging[(size_t) (i - reg.row_begin) * width], &grid(i, reg.col_begin), width * sizeof(float));
+
+        int rank;
+        MPI_Comm_rank(comm, &rank);
+        std::string tmp = path + ".tmp";
+        if (MPI_File_open(comm, tmp.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+            if (rank == 0)
+                std::cerr << "Warning: cannot write checkpoint " << tmp << std::endl;
+            return;
+        }
+        MPI_File_set_size(fh, sizeof(CheckpointHeader) + (MPI_Offset) rows * cols * sizeof(float));
+        if (rank == 0) {
+            CheckpointHeader header = make_checkpoint_header(rows, cols, solver, sweep, schedule);
+            MPI_File_write_at(fh, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+        }
+        MPI_File_set_view(fh, sizeof(CheckpointHeader), MPI_FLOAT, reg.filetype, "native", MPI_INFO_NULL);
+        MPI_File_iwrite_all(fh, staging.data(), (int) staging.size(), MPI_FLOAT, &request);
+        pending = true;
+    }
+
+    // Waits for the pending write, if any, and renames it into place.
+    void wait() {
+        if (!pending)
+            return;
+        pending = false;
+        MPI_Wait(&request, MPI_STATUS_IGNORE);
+        MPI_File_close(&fh);
+        int rank;
+        MPI_Comm_rank(comm, &rank);
+        if (rank == 0 && rename((path + ".tmp").c_str(), path.c_str()) != 0)
+            std::cerr << "Warning: cannot write checkpoint " << path << std::endl;
+    }
+
+    // Waits for the pending write and releases the file type.
+    void finish() {
+        wait();
+        if (every > 0)
+            MPI_Type_free(&reg.filetype);
+    }
+
+private:
+    std::string path;
+    long every, saved;
+    int rows, cols, solver;
+    MPI_Comm comm;
+    BlockRegion reg;
+    std::vector<float> staging;
+    MPI_File fh;
+    MPI_Request request;
+    bool pending;
+};
+
+#endif
@@ -0,0 +1,455 @@
+#ifndef HOTPLATE_GRID_H
+#define HOTPLATE_GRID_H
+
+// Plate storage and stencil kernels shared by the ExerciseII solvers.
+//
+// The plate is one contiguous row-major float buffer whose rows are padded to
+// a multiple of 64 bytes, so every row starts aligned and neighbours are a
+// fixed stride apart. sweep_rows() updates whole interior rows without
+// testing for fixed cells (they are put back afterwards) and computes the max
+// residual of the new values in the same pass, skipping the fixed cells. The
+// row kernels use the widest SIMD the CPU supports (AVX-512, AVX2 or scalar),
+// chosen once at runtime, and round exactly like the original per-cell
+// expressions. redblack_rows() is the in-place alternative for the red-black
+// Gauss-Seidel and SOR solvers.
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <vector>
+#include <immintrin.h>
+
+#include "hotplate_scenario.h"
+
+const size_t PLATE_ALIGNMENT = 64;
+const int PLATE_ROW_FLOATS = PLATE_ALIGNMENT / sizeof(float);
+
+class PlateGrid {
+public:
+    PlateGrid() : ptr(nullptr), nrows(0), ncols(0), ld(0) {}
+    PlateGrid(int rows, int cols) : ptr(nullptr), nrows(0), ncols(0), ld(0) { allocate(rows, cols); }
+    ~PlateGrid() { free(ptr); }
+    PlateGrid(const PlateGrid&) = delete;
+    PlateGrid& operator=(const PlateGrid&) = delete;
+    PlateGrid(PlateGrid &&o) : ptr(o.ptr), nrows(o.nrows), ncols(o.ncols), ld(o.ld) { o.ptr = nullptr; o.nrows = o.ncols = o.ld = 0; }
+    PlateGrid& operator=(PlateGrid &&o) {
+        std::swap(ptr, o.ptr); std::swap(nrows, o.nrows); std::swap(ncols, o.ncols); std::swap(ld, o.ld);
+        return *this;
+    }
+
+    // Zero-filled rows x cols plate.
+    void allocate(int rows, int cols) {
+        free(ptr);
+        ptr = nullptr;
+        nrows = rows;
+        ncols = cols;
+        ld = (cols + PLATE_ROW_FLOATS - 1) / PLATE_ROW_FLOATS * PLATE_ROW_FLOATS;
+        size_t bytes = (size_t) nrows * ld * sizeof(float);
+        if (bytes > 0) {
+            if (!(ptr = (float*) aligned_alloc(PLATE_ALIGNMENT, bytes)))
+                throw std::bad_alloc();
+            for (size_t k = 0; k < (size_t) nrows * ld; k++)
+                ptr[k] = 0.0f;
+        }
+    }
+
+    int rows() const { return nrows; }
+    int cols() const { return ncols; }
+    // Distance in floats between vertically adjacent cells.
+    size_t stride() const { return ld; }
+
+    float* data() { return ptr; }
+    const float* data() const { return ptr; }
+    float* row(int i) { return ptr + (size_t) i * ld; }
+    const float* row(int i) const { return ptr + (size_t) i * ld; }
+    float& operator()(int i, int j) { return ptr[(size_t) i * ld + j]; }
+    const float& operator()(int i, int j) const { return ptr[(size_t) i * ld + j]; }
+
+private:
+    float *ptr;
+    int nrows, ncols;
+    size_t ld;
+};
+
+// Fills rows [row_begin, row_end) of the grid from the scenario; grid row i
+// holds global row i + row_offset.
+inline void initialize_plate(PlateGrid &grid, const Scenario &scenario, int global_rows, int row_offset,
+                             int row_begin, int row_end) {
+    for (int i = row_begin; i < row_end; i++)
+        scenario.row_cells(global_rows, grid.cols(), i + row_offset, 0, grid.cols(), grid.row(i));
+}
+
+// Fills the whole grid as a block of a global_rows x global_cols plate: grid
+// cell (i, j) holds global cell (i + row_offset, j + col_offset). Cells that
+// fall outside the plate are left as they are.
+inline void initialize_block(PlateGrid &grid, const Scenario &scenario, int global_rows, int global_cols,
+                             int row_offset, int col_offset) {
+    int j0 = std::max(0, -col_offset);
+    int j1 = std::min(grid.cols(), global_cols - col_offset);
+    for (int i = 0; i < grid.rows(); i++) {
+        int g = i + row_offset;
+        if (g < 0 || g >= global_rows || j1 <= j0)
+            continue;
+        scenario.row_cells(global_rows, global_cols, g, j0 + col_offset, j1 + col_offset, grid.row(i) + j0);
+    }
+}
+
+// Interior cells that keep their initial value, from the fixed regions of
+// the scenario. Stored as grid coordinates, sorted by row, with the value
+// they keep.
+struct FixedCells {
+    std::vector<int> rows;
+    std::vector<int> cols;
+    std::vector<float> values;
+    size_t size() const { return rows.size(); }
+};
+
+// Fixed cells of the interior of a global_rows x global_cols plate that fall
+// in grid rows [row_begin, row_end), with grid row i = global row i + row_offset.
+// A grid holding a block of columns passes col_offset (grid column j = global
+// column j + col_offset) and its own columns [col_begin, col_end).
+inline FixedCells plate_fixed_cells(const Scenario &scenario, int global_rows, int global_cols, int row_offset,
+                                    int row_begin, int row_end,
+                                    int col_offset = 0, int col_begin = 1, int col_end = INT_MAX) {
+    FixedCells fixed;
+    // Global interior columns of the window.
+    int j0 = std::max(1, col_begin + col_offset);
+    int j1 = (int) std::min<long long>(global_cols - 1, (long long) col_end + col_offset);
+    if (j1 <= j0)
+        return fixed;
+    std::vector<float> values(j1 - j0);
+    std::vector<unsigned char> held(j1 - j0);
+    for (int i = row_begin; i < row_end; i++) {
+        int g = i + row_offset;
+        if (g <= 0 || g >= global_rows - 1)
+            continue;
+        scenario.row_cells(global_rows, global_cols, g, j0, j1, values.data(), held.data());
+        for (int j = j0; j < j1; j++) {
+            if (held[j - j0]) {
+                fixed.rows.push_back(i);
+                fixed.cols.push_back(j - col_offset);
+                fixed.values.push_back(values[j - j0]);
+            }
+        }
+    }
+    return fixed;
+}
+
+// ---- Row kernels ----
+// All kernels work on the interior cells 1..len of one row: mid points at the
+// row, up/down at its neighbours. stencil_row writes
+//   dst[j] = (down[j] + up[j] + mid[j+1] + mid[j-1] + 4*mid[j]) / 8
+// and max_residual_row returns the largest
+//   |mid[j] - (down[j] + up[j] + mid[j+1] + mid[j-1]) / 4|
+// (0 for an empty row). The sums are formed in this order in every kernel,
+// and dividing by 8 or 4 is the same as the exact multiplication by 0.125 or
+// 0.25, so all kernels produce the same bits.
+
+inline void stencil_row_scalar(float *dst, const float *up, const float *mid, const float *down, int len) {
+    for (int j = 1; j <= len; j++)
+        dst[j] = (down[j] + up[j] + mid[j+1] + mid[j-1] + 4 * mid[j]) / 8.0f;
+}
+
+inline float max_residual_row_scalar(const float *up, const float *mid, const float *down, int len) {
+    float res = 0.0f;
+    for (int j = 1; j <= len; j++)
+        res = std::max(res, fabsf(mid[j] - (down[j] + up[j] + mid[j+1] + mid[j-1]) / 4.0f));
+    return res;
+}
+
+// Red-black update: the cells j of 1..len with j % 2 == parity become
+//   (1 - omega) * mid[j] + omega * (down[j] + up[j] + mid[j+1] + mid[j-1]) / 4
+// in place; the other cells are neither read as centers nor written, so a
+// neighbouring worker may read them at the same time.
+inline void sor_row_scalar(float *mid, const float *up, const float *down, int len, int parity, float omega) {
+    for (int j = parity ? 1 : 2; j <= len; j += 2)
+        mid[j] = (1.0f - omega) * mid[j] + omega * ((down[j] + up[j] + mid[j+1] + mid[j-1]) / 4.0f);
+}
+
+// ---- AVX2 ----
+
+__attribute__((target("avx2")))
+inline void stencil_row_avx2(float *dst, const float *up, const float *mid, const float *down, int len) {
+    const __m256 four = _mm256_set1_ps(4.0f), eighth = _mm256_set1_ps(0.125f);
+    int j = 1;
+    for (; j + 8 <= len + 1; j += 8) {
+        __m256 s = _mm256_add_ps(_mm256_loadu_ps(down + j), _mm256_loadu_ps(up + j));
+        s = _mm256_add_ps(s, _mm256_loadu_ps(mid + j + 1));
+        s = _mm256_add_ps(s, _mm256_loadu_ps(mid + j - 1));
+        s = _mm256_add_ps(s, _mm256_mul_ps(four, _mm256_loadu_ps(mid + j)));
+        _mm256_storeu_ps(dst + j, _mm256_mul_ps(s, eighth));
+    }
+    for (; j <= len; j++)
+        dst[j] = (down[j] + up[j] + mid[j+1] + mid[j-1] + 4 * mid[j]) / 8.0f;
+}
+
+__attribute__((target("avx2")))
+inline float max_residual_row_avx2(const float *up, const float *mid, const float *down, int len) {
+    const __m256 quarter = _mm256_set1_ps(0.25f);
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    __m256 vres = _mm256_setzero_ps();
+    int j = 1;
+    for (; j + 8 <= len + 1; j += 8) {
+        __m256 s = _mm256_add_ps(_mm256_loadu_ps(down + j), _mm256_loadu_ps(up + j));
+        s = _mm256_add_ps(s, _mm256_loadu_ps(mid + j + 1));
+        s = _mm256_add_ps(s, _mm256_loadu_ps(mid + j - 1));
+        __m256 r = _mm256_and_ps(_mm256_sub_ps(_mm256_loadu_ps(mid + j), _mm256_mul_ps(s, quarter)), abs_mask);
+        vres = _mm256_max_ps(vres, r);
+    }
+    alignas(32) float lanes[8];
+    _mm256_store_ps(lanes, vres);
+    float res = 0.0f;
+    for (int k = 0; k < 8; k++)
+        res = std::max(res, lanes[k]);
+    for (; j <= len; j++)
+        res = std::max(res, fabsf(mid[j] - (down[j] + up[j] + mid[j+1] + mid[j-1]) / 4.0f));
+    return res;
+}
+
+// The vector loop starts at column 1, so lane k holds a column of parity
+// (k + 1) % 2 in every iteration.
+__attribute__((target("avx2")))
+inline void sor_row_avx2(float *mid, const float *up, const float *down, int len, int parity, float omega) {
+    const __m256 quarter = _mm256_set1_ps(0.25f), w = _mm256_set1_ps(omega), keep = _mm256_set1_ps(1.0f - omega);
+    const __m256i color = parity ? _mm256_setr_epi32(-1, 0, -1, 0, -1, 0, -1, 0)
+                                 : _mm256_setr_epi32(0, -1, 0, -1, 0, -1, 0, -1);
+    int j = 1;
+    for (; j + 8 <= len + 1; j += 8) {
+        __m256 s = _mm256_add_ps(_mm256_loadu_ps(down + j), _mm256_loadu_ps(up + j));
+        s = _mm256_add_ps(s, _mm256_loadu_ps(mid + j + 1));
+        s = _mm256_add_ps(s, _mm256_loadu_ps(mid + j - 1));
+        __m256 v = _mm256_add_ps(_mm256_mul_ps(keep, _mm256_loadu_ps(mid + j)), _mm256_mul_ps(w, _mm256_mul_ps(s, quarter)));
+        _mm256_maskstore_ps(mid + j, color, v);
+    }
+    for (j += (j & 1) != parity; j <= len; j += 2)
+        mid[j] = (1.0f - omega) * mid[j] + omega * ((down[j] + up[j] + mid[j+1] + mid[j-1]) / 4.0f);
+}
+
+// ---- AVX-512 ----
+// Masked loads and stores handle the end of the row without a scalar tail;
+// masked-off lanes load zeros and so have residual 0. The max uses the
+// all-lanes maskz form because the unmasked one starts from an "undefined"
+// vector GCC 12 warns about.
+
+__attribute__((target("avx512f")))
+inline __mmask16 plate_tail_mask16(int left) {
+    return left >= 16 ? (__mmask16) 0xFFFF : (__mmask16) ((1u << left) - 1);
+}
+
+__attribute__((target("avx512f")))
+inline void stencil_row_avx512(float *dst, const float *up, const float *mid, const float *down, int len) {
+    const __m512 four = _mm512_set1_ps(4.0f), eighth = _mm512_set1_ps(0.125f);
+    for (int j = 1; j <= len; j += 16) {
+        __mmask16 m = plate_tail_mask16(len + 1 - j);
+        __m512 s = _mm512_add_ps(_mm512_maskz_loadu_ps(m, down + j), _mm512_maskz_loadu_ps(m, up + j));
+        s = _mm512_add_ps(s, _mm512_maskz_loadu_ps(m, mid + j + 1));
+        s = _mm512_add_ps(s, _mm512_maskz_loadu_ps(m, mid + j - 1));
+        s = _mm512_add_ps(s, _mm512_mul_ps(four, _mm512_maskz_loadu_ps(m, mid + j)));
+        _mm512_mask_storeu_ps(dst + j, m, _mm512_mul_ps(s, eighth));
+    }
+}
+
+__attribute__((target("avx512f")))
+inline float max_residual_row_avx512(const float *up, const float *mid, const float *down, int len) {
+    const __m512 quarter = _mm512_set1_ps(0.25f);
+    __m512 vres = _mm512_setzero_ps();
+    for (int j = 1; j <= len; j += 16) {
+        __mmask16 m = plate_tail_mask16(len + 1 - j);
+        __m512 s = _mm512_add_ps(_mm512_maskz_loadu_ps(m, down + j), _mm512_maskz_loadu_ps(m, up + j));
+        s = _mm512_add_ps(s, _mm512_maskz_loadu_ps(m, mid + j + 1));
+        s = _mm512_add_ps(s, _mm512_maskz_loadu_ps(m, mid + j - 1));
+        __m512 r = _mm512_abs_ps(_mm512_sub_ps(_mm512_maskz_loadu_ps(m, mid + j), _mm512_mul_ps(s, quarter)));
+        vres = _mm512_maskz_max_ps((__mmask16) 0xFFFF, vres, r);
+    }
+    // Lane max through memory; the reduce intrinsics trip -Wmaybe-uninitialized in GCC 12.
+    alignas(64) float lanes[16];
+    _mm512_store_ps(lanes, vres);
+    float res = 0.0f;
+    for (int k = 0; k < 16; k++)
+        res = std::max(res, lanes[k]);
+    return res;
+}
+
+__attribute__((target("avx512f")))
+inline void sor_row_avx512(float *mid, const float *up, const float *down, int len, int parity, float omega) {
+    const __m512 quarter = _mm512_set1_ps(0.25f), w = _mm512_set1_ps(omega), keep = _mm512_set1_ps(1.0f - omega);
+    const __mmask16 color = parity ? (__mmask16) 0x5555 : (__mmask16) 0xAAAA;
+    for (int j = 1; j <= len; j += 16) {
+        __mmask16 m = plate_tail_mask16(len + 1 - j) & color;
+        __m512 s = _mm512_add_ps(_mm512_maskz_loadu_ps(m, down + j), _mm512_maskz_loadu_ps(m, up + j));
+        s = _mm512_add_ps(s, _mm512_maskz_loadu_ps(m, mid + j + 1));
+        s = _mm512_add_ps(s, _mm512_maskz_loadu_ps(m, mid + j - 1));
+        __m512 v = _mm512_add_ps(_mm512_mul_ps(keep, _mm512_maskz_loadu_ps(m, mid + j)),
+                                 _mm512_mul_ps(w, _mm512_mul_ps(s, quarter)));
+        _mm512_mask_storeu_ps(mid + j, m, v);
+    }
+}
+
+struct StencilKernels {
+    void (*stencil_row)(float *dst, const float *up, const float *mid, const float *down, int len);
+    float (*max_residual_row)(const float *up, const float *mid, const float *down, int len);
+    void (*sor_row)(float *mid, const float *up, const float *down, int len, int parity, float omega);
+};
+
+inline StencilKernels select_stencil_kernels() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return StencilKernels{stencil_row_avx512, max_residual_row_avx512, sor_row_avx512};
+    if (__builtin_cpu_supports("avx2"))
+        return StencilKernels{stencil_row_avx2, max_residual_row_avx2, sor_row_avx2};
+    return StencilKernels{stencil_row_scalar, max_residual_row_scalar, sor_row_scalar};
+}
+
+inline const StencilKernels& stencil_kernels() {
+    static const StencilKernels kernels = select_stencil_kernels();
+    return kernels;
+}
+
+// ---- Grid sweeps ----
+
+// The sweeps below work on the interior columns [col_begin, col_end) of each
+// row; col_end 0 stands for the last interior column + 1, so by default a row
+// is taken whole. A narrower window lets a caller update or check the columns
+// next to a ghost column separately from the rest.
+inline int window_end(const PlateGrid &grid, int col_end) {
+    return col_end > 0 ? col_end : grid.cols() - 1;
+}
+
+// Max residual of columns [col_begin, col_end) of grid row i, leaving out its
+// fixed cells: the window is split into the runs between them. k is a cursor
+// into fixed that only moves forward, so calls must come in increasing row
+// order.
+inline float row_max_residual(const StencilKernels &kern, const FixedCells &fixed, size_t &k,
+                              const PlateGrid &grid, int i, int col_begin = 1, int col_end = 0) {
+    size_t ld = grid.stride();
+    const float *mid = grid.row(i);
+    col_end = window_end(grid, col_end);
+    while (k < fixed.size() && fixed.rows[k] < i)
+        k++;
+    float res = 0.0f;
+    int j = col_begin;
+    for (; k < fixed.size() && fixed.rows[k] == i; k++) {
+        int c = fixed.cols[k];
+        if (c < col_begin || c >= col_end)
+            continue;
+        // Cells j .. c-1, passed with the 1-based kernel convention.
+        res = std::max(res, kern.max_residual_row(mid - ld + j - 1, mid + j - 1, mid + ld + j - 1, c - j));
+        j = c + 1;
+    }
+    return std::max(res, kern.max_residual_row(mid - ld + j - 1, mid + j - 1, mid + ld + j - 1, col_end - j));
+}
+
+// One Jacobi sweep of rows [row_begin, row_end) of dst from src, interior
+// columns only, fused with the convergence check of the result.
+//
+// The residual of a new row needs the new rows above and below it, so it is
+// taken one row behind the update while those rows are still in cache. Fixed
+// cells are overwritten by the row kernel and copied back from src (which,
+// never updated, still holds their initial value) before the row is used.
+//
+// Returns the max residual of dst rows [row_begin+1, row_end-1). The first and
+// last row depend on rows other workers (or ranks) write; once those are done
+// add them with edge_max_residual(). With check false only the update runs
+// and the result is 0.
+inline float sweep_rows(const FixedCells &fixed, const PlateGrid &src, PlateGrid &dst, int row_begin, int row_end,
+                        bool check = true, int col_begin = 1, int col_end = 0) {
+    const StencilKernels &kern = stencil_kernels();
+    size_t ld = src.stride();
+    col_end = window_end(src, col_end);
+    int len = col_end - col_begin, off = col_begin - 1;
+    size_t kf = std::lower_bound(fixed.rows.begin(), fixed.rows.end(), row_begin) - fixed.rows.begin();
+    size_t kr = kf;
+    float res = 0.0f;
+    for (int i = row_begin; i < row_end; i++) {
+        const float *mid = src.row(i);
+        float *out = dst.row(i);
+        kern.stencil_row(out + off, mid - ld + off, mid + off, mid + ld + off, len);
+        for (; kf < fixed.size() && fixed.rows[kf] == i; kf++)
+            if (fixed.cols[kf] >= col_begin && fixed.cols[kf] < col_end)
+                out[fixed.cols[kf]] = mid[fixed.cols[kf]];
+        if (check && i - 1 > row_begin)
+            res = std::max(res, row_max_residual(kern, fixed, kr, dst, i - 1, col_begin, col_end));
+    }
+    return res;
+}
+
+// One half of a red-black SOR sweep over rows [row_begin, row_end): the cells
+// whose color (global row + column) % 2 equals `color` are updated in place,
+// see sor_row_scalar(). Grid row i holds global row i + row_offset. Cells of
+// one color only read cells of the other, so workers can take any rows; the
+// fixed cells of the color are put back from their stored values.
+//
+// A sweep is color 0 then color 1. With check, the second half also returns
+// the max residual of rows [row_begin+1, row_end-1), taken one row behind the
+// update as in sweep_rows(); edge_max_residual() adds the first and last row.
+inline float redblack_rows(const FixedCells &fixed, PlateGrid &grid, int row_begin, int row_end, int row_offset,
+                           int color, float omega, bool check = false) {
+    const StencilKernels &kern = stencil_kernels();
+    size_t ld = grid.stride();
+    int len = grid.cols() - 2;
+    size_t kf = std::lower_bound(fixed.rows.begin(), fixed.rows.end(), row_begin) - fixed.rows.begin();
+    size_t kr = kf;
+    float res = 0.0f;
+    for (int i = row_begin; i < row_end; i++) {
+        float *mid = grid.row(i);
+        int parity = (i + row_offset + color) & 1;
+        kern.sor_row(mid, mid - ld, mid + ld, len, parity, omega);
+        for (; kf < fixed.size() && fixed.rows[kf] == i; kf++)
+            if ((fixed.cols[kf] & 1) == parity)
+                mid[fixed.cols[kf]] = fixed.values[kf];
+        if (check && i - 1 > row_begin)
+            res = std::max(res, row_max_residual(kern, fixed, kr, grid, i - 1));
+    }
+    return res;
+}
+
+// Over-relaxation factor for red-black SOR on a rows x cols plate: the
+// optimum for the Laplace equation on a square of the larger side,
+// 2 / (1 + sin(pi / (n - 1))).
+inline float sor_default_omega(int rows, int cols) {
+    int n = std::max(std::max(rows, cols), 3);
+    return (float) (2.0 / (1.0 + sin(M_PI / (n - 1))));
+}
+
+// Max residual of rows row_begin and row_end-1 of grid, the rows sweep_rows()
+// and redblack_rows() leave out.
+inline float edge_max_residual(const FixedCells &fixed, const PlateGrid &grid, int row_begin, int row_end,
+                               int col_begin = 1, int col_end = 0) {
+    if (row_end <= row_begin)
+        return 0.0f;
+    const StencilKernels &kern = stencil_kernels();
+    size_t k = std::lower_bound(fixed.rows.begin(), fixed.rows.end(), row_begin) - fixed.rows.begin();
+    float res = row_max_residual(kern, fixed, k, grid, row_begin, col_begin, col_end);
+    if (row_end - 1 > row_begin)
+        res = std::max(res, row_max_residual(kern, fixed, k, grid, row_end - 1, col_begin, col_end));
+    return res;
+}
+
+// Max residual of rows [row_begin, row_end) of grid, without updating it.
+inline float max_residual_rows(const FixedCells &fixed, const PlateGrid &grid, int row_begin, int row_end,
+                               int col_begin = 1, int col_end = 0) {
+    const StencilKernels &kern = stencil_kernels();
+    size_t k = std::lower_bound(fixed.rows.begin(), fixed.rows.end(), row_begin) - fixed.rows.begin();
+    float res = 0.0f;
+    for (int i = row_begin; i < row_end; i++)
+        res = std::max(res, row_max_residual(kern, fixed, k, grid, i, col_begin, col_end));
+    return res;
+}
+
+// Cells of rows [row_begin, row_end) above 50 degrees.
+inline int count_hot_cells(const PlateGrid &grid, int row_begin, int row_end) {
+    int count = 0;
+    for (int i = row_begin; i < row_end; i++) {
+        const float *r = grid.row(i);
+        for (int j = 0; j < grid.cols(); j++)
+            if (r[j] > 50.0f)
+                count++;
+    }
+    return count;
+}
+
+#endif
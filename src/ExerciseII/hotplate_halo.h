@@ -0,0 +1,192 @@
+#ifndef HOTPLATE_HALO_H
+#define HOTPLATE_HALO_H
+
+// 2D block decomposition of the hotplate over MPI ranks, shared by the MPI
+// and the hybrid MPI + OpenMP versions.
+//
+// The interior cells of the plate are split into p x q blocks on a Cartesian
+// process grid. Each rank keeps its block inside a ring of ghost cells, which
+// hold either a neighbour's edge cells or, along the plate's edge, the fixed
+// border, so every rank updates its whole block.
+
+#include <mpi.h>
+#include <algorithm>
+
+#include "hotplate_grid.h"
+#include "hotplate_options.h"
+
+// This rank's block of the plate in the 2D process grid: the local cells
+// (1..rows, 1..cols) inside a ring of ghost cells. Grid cell (i, j) is global
+// cell (i + row_offset, j + col_offset). A plate with fewer than three rows or
+// columns has no interior, and its one block is empty (rows or cols 0).
+struct LocalBlock {
+    int rows, cols;
+    int row_offset, col_offset;
+    int plate_rows, plate_cols; // of the whole plate
+    int up, down, left, right; // neighbour ranks in comm, MPI_PROC_NULL at the plate's edge
+    MPI_Comm comm;
+    MPI_Datatype column;       // one column of the local cells: rows floats a grid stride apart
+                               // (MPI_DATATYPE_NULL for an empty block)
+
+    bool empty() const { return rows == 0 || cols == 0; }
+};
+
+// First item and number of items of part k when n items are split into
+// `parts` contiguous parts; the first n % parts parts get one more.
+inline void split_range(int n, int parts, int k, int &first, int &count) {
+    count = n / parts + (k < n % parts ? 1 : 0);
+    first = k * (n / parts) + std::min(k, n % parts);
+}
+
+// Process grid p x q over the interior cells (rows x cols) of the plate: of
+// the factorizations that leave every rank at least one row and column, the
+// one with the shortest halo per rank, cols/q + rows/p. Uses all nprocs ranks
+// when some factorization of nprocs fits, otherwise the most that do.
+inline void choose_process_grid(int nprocs, int rows, int cols, int dims[2]) {
+    for (int n = nprocs; n >= 1; n--) {
+        double best = -1.0;
+        for (int p = 1; p <= n; p++) {
+            int q = n / p;
+            if (p * q != n || p > rows || q > cols)
+                continue;
+            double halo = (double) cols / q + (double) rows / p;
+            if (best < 0.0 || halo < best) {
+                best = halo;
+                dims[0] = p;
+                dims[1] = q;
+            }
+        }
+        if (best >= 0.0)
+            return;
+    }
+}
+
+// Arranges the processes of MPI_COMM_WORLD in a 2D grid and gives this one
+// its block of a global_rows x global_cols plate. A plate too small for every
+// process leaves the extra ones out of the grid; for those it returns false
+// and they have nothing to do. The column type is set up by
+// commit_block_column() once the grid stride is known.
+inline bool create_local_block(int global_rows, int global_cols, LocalBlock &block) {
+    int nprocs, rank;
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+    int dims[2] = {1, 1};
+    choose_process_grid(nprocs, std::max(global_rows - 2, 1), std::max(global_cols - 2, 1), dims);
+    int periods[2] = {0, 0};
+    int coords[2];
+    MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 1, &block.comm);
+    if (block.comm == MPI_COMM_NULL)
+        return false;
+    MPI_Comm_rank(block.comm, &rank);
+    MPI_Cart_coords(block.comm, rank, 2, coords);
+    MPI_Cart_shift(block.comm, 0, 1, &block.up, &block.down);
+    MPI_Cart_shift(block.comm, 1, 1, &block.left, &block.right);
+
+    // Local cell (1, 1) is the first interior cell of the block.
+    int first_row, first_col;
+    split_range(std::max(global_rows - 2, 0), dims[0], coords[0], first_row, block.rows);
+    split_range(std::max(global_cols - 2, 0), dims[1], coords[1], first_col, block.cols);
+    block.row_offset = first_row;
+    block.col_offset = first_col;
+    block.plate_rows = global_rows;
+    block.plate_cols = global_cols;
+    return true;
+}
+
+// An empty block is the only one of its plate (choose_process_grid() gives
+// a plate without interior a 1 x 1 grid), so it exchanges nothing and needs
+// no column type.
+inline void commit_block_column(LocalBlock &block, const PlateGrid &grid) {
+    block.column = MPI_DATATYPE_NULL;
+    if (block.empty())
+        return;
+    MPI_Type_vector(block.rows, 1, (int) grid.stride(), MPI_FLOAT, &block.column);
+    MPI_Type_commit(&block.column);
+}
+
+inline void free_local_block(LocalBlock &block) {
+    if (block.column != MPI_DATATYPE_NULL)
+        MPI_Type_free(&block.column);
+    MPI_Comm_free(&block.comm);
+}
+
+// Cells of grid that hold the part of the plate this rank accounts for: the
+// local cells, plus the border cells held in the ghost cells along the
+// plate's edge. Local rows [row_begin, row_end) by columns [col_begin, col_end).
+// On a plate of one row or column the far ghost cells lie outside it and are
+// left out.
+inline void block_plate_cells(const LocalBlock &block, int &row_begin, int &row_end, int &col_begin, int &col_end) {
+    row_begin = block.up == MPI_PROC_NULL ? 0 : 1;
+    row_end = block.down == MPI_PROC_NULL ? std::min(block.rows + 2, block.plate_rows - block.row_offset)
+                                          : block.rows + 1;
+    col_begin = block.left == MPI_PROC_NULL ? 0 : 1;
+    col_end = block.right == MPI_PROC_NULL ? std::min(block.cols + 2, block.plate_cols - block.col_offset)
+                                           : block.cols + 1;
+}
+
+// Posts the transfers that fill the ghost cells of grid: the edge rows and
+// columns of the local cells go to the four neighbours and theirs come back.
+// Transfers to MPI_PROC_NULL complete at once, so the plate's border stays in
+// the ghost cells along its edge. The 8 requests complete in MPI_Waitall; an
+// empty block leaves them null.
+inline void start_ghost_exchange(PlateGrid &grid, const LocalBlock &block, MPI_Request req[8]) {
+    if (block.empty()) {
+        std::fill(req, req + 8, MPI_REQUEST_NULL);
+        return;
+    }
+    int lr = block.rows, lc = block.cols;
+    MPI_Irecv(&grid(0, 1), lc, MPI_FLOAT, block.up, 0, block.comm, &req[0]);
+    MPI_Irecv(&grid(lr + 1, 1), lc, MPI_FLOAT, block.down, 0, block.comm, &req[1]);
+    MPI_Irecv(&grid(1, 0), 1, block.column, block.left, 0, block.comm, &req[2]);
+    MPI_Irecv(&grid(1, lc + 1), 1, block.column, block.right, 0, block.comm, &req[3]);
+    MPI_Isend(&grid(1, 1), lc, MPI_FLOAT, block.up, 0, block.comm, &req[4]);
+    MPI_Isend(&grid(lr, 1), lc, MPI_FLOAT, block.down, 0, block.comm, &req[5]);
+    MPI_Isend(&grid(1, 1), 1, block.column, block.left, 0, block.comm, &req[6]);
+    MPI_Isend(&grid(1, lc), 1, block.column, block.right, 0, block.comm, &req[7]);
+}
+
+// Exchange of the ghost cells of grid, waiting for it to complete.
+inline void exchange_ghosts(PlateGrid &grid, const LocalBlock &block) {
+    MPI_Request req[8];
+    start_ghost_exchange(grid, block, req);
+    MPI_Waitall(8, req, MPI_STATUSES_IGNORE);
+}
+
+// Blocking exchange with one MPI_Sendrecv per direction.
+inline void sendrecv_ghosts(PlateGrid &grid, const LocalBlock &block) {
+    if (block.empty())
+        return;
+    int lr = block.rows, lc = block.cols;
+    MPI_Sendrecv(&grid(1, 1), lc, MPI_FLOAT, block.up, 0,
+                 &grid(lr + 1, 1), lc, MPI_FLOAT, block.down, 0, block.comm, MPI_STATUS_IGNORE);
+    MPI_Sendrecv(&grid(lr, 1), lc, MPI_FLOAT, block.down, 0,
+                 &grid(0, 1), lc, MPI_FLOAT, block.up, 0, block.comm, MPI_STATUS_IGNORE);
+    MPI_Sendrecv(&grid(1, 1), 1, block.column, block.left, 0,
+                 &grid(1, lc + 1), 1, block.column, block.right, 0, block.comm, MPI_STATUS_IGNORE);
+    MPI_Sendrecv(&grid(1, lc), 1, block.column, block.right, 0,
+                 &grid(1, 0), 1, block.column, block.left, 0, block.comm, MPI_STATUS_IGNORE);
+}
+
+// Combines the ranks' residuals of a checked sweep; all ranks get the same
+// answer, so their schedules stay in step.
+inline bool global_converged(ConvergenceSchedule &schedule, long sweep, float local_residual, MPI_Comm comm) {
+    float global_residual;
+    MPI_Allreduce(&local_residual, &global_residual, 1, MPI_FLOAT, MPI_MAX, comm);
+    return schedule.converged(sweep, global_residual);
+}
+
+// Hot cells of grid row i that this rank counts: the local cells, plus the
+// border cells held in the ghost cells along the plate's edge.
+inline int block_hot_cells(const PlateGrid &grid, const LocalBlock &block, int i) {
+    int row_begin, row_end, col_begin, col_end;
+    block_plate_cells(block, row_begin, row_end, col_begin, col_end);
+    if (i < row_begin || i >= row_end)
+        return 0;
+    const float *r = grid.row(i);
+    int hot = 0;
+    for (int j = col_begin; j < col_end; j++)
+        if (r[j] > 50.0f)
+            hot++;
+    return hot;
+}
+
+#endif
@@ -0,0 +1,278 @@
+#include <mpi.h>
+#include <omp.h>
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "hotplate_checkpoint_mpi.h"
+#include "hotplate_grid.h"
+#include "hotplate_halo.h"
+#include "hotplate_options.h"
+#include "hotplate_snapshot_mpi.h"
+
+using namespace std;
+
+// Hybrid version: each MPI rank owns a block of the plate, as in
+// hotplate_mpi.cpp, and its OpenMP threads share the sweeps of the block.
+// Only the master thread calls MPI (MPI_THREAD_FUNNELED); the other threads
+// keep updating while it exchanges the ghost cells.
+
+// Contiguous share of [begin, end) for the calling thread.
+void thread_share(int begin, int end, int &b, int &e) {
+    int nthreads = omp_get_num_threads(), tid = omp_get_thread_num();
+    int n = end - begin;
+    b = begin + (int) ((long long) n * tid / nthreads);
+    e = begin + (int) ((long long) n * (tid + 1) / nthreads);
+}
+
+// One Jacobi sweep of dst from src (whose ghost cells are current) that
+// leaves the ghost cells of dst current too. With overlap the threads first
+// compute the edge rows and columns of the block, the master thread sends
+// them and then joins the update of the core while they are in flight, and
+// waits for the exchange once its share is done. Without overlap the sweep
+// is followed by a blocking exchange. With check, returns the max residual
+// of this rank's new values.
+float hybrid_sweep(const FixedCells &fixed_cells, const PlateGrid &src, PlateGrid &dst, const LocalBlock &block,
+                   bool overlap, bool check) {
+    int lr = block.rows, lc = block.cols;
+    float residual = 0.0f;
+    if (!overlap || lr < 3 || lc < 3) {
+        #pragma omp parallel reduction(max:residual)
+        {
+            int rb, re;
+            thread_share(1, lr + 1, rb, re);
+            sweep_rows(fixed_cells, src, dst, rb, re, false);
+            #pragma omp barrier
+            #pragma omp master
+            sendrecv_ghosts(dst, block);
+            if (check) {
+                #pragma omp barrier
+                residual = max_residual_rows(fixed_cells, dst, rb, re);
+            }
+        }
+        return residual;
+    }
+
+    MPI_Request req[8];
+    #pragma omp parallel reduction(max:residual)
+    {
+        // Each thread takes a share of the columns of the edge rows and of
+        // the rows of the edge columns and core.
+        int cb, ce, rb, re;
+        thread_share(1, lc + 1, cb, ce);
+        thread_share(2, lr, rb, re);
+        sweep_rows(fixed_cells, src, dst, 1, 2, false, cb, ce);
+        sweep_rows(fixed_cells, src, dst, lr, lr + 1, false, cb, ce);
+        sweep_rows(fixed_cells, src, dst, rb, re, false, 1, 2);
+        sweep_rows(fixed_cells, src, dst, rb, re, false, lc, lc + 1);
+        #pragma omp barrier
+        #pragma omp master
+        start_ghost_exchange(dst, block, req);
+
+        // The core, rows 2..lr-1 by columns 2..lc-1, reads no ghost cells.
+        residual = sweep_rows(fixed_cells, src, dst, rb, re, check, 2, lc);
+        if (check) {
+            #pragma omp barrier
+            residual = max(residual, edge_max_residual(fixed_cells, dst, rb, re, 2, lc));
+        }
+        #pragma omp master
+        MPI_Waitall(8, req, MPI_STATUSES_IGNORE);
+        if (check) {
+            #pragma omp barrier
+            residual = max(residual, max_residual_rows(fixed_cells, dst, 1, 2, cb, ce));
+            residual = max(residual, max_residual_rows(fixed_cells, dst, lr, lr + 1, cb, ce));
+            residual = max(residual, max_residual_rows(fixed_cells, dst, rb, re, 1, 2));
+            residual = max(residual, max_residual_rows(fixed_cells, dst, rb, re, lc, lc + 1));
+        }
+    }
+    return residual;
+}
+
+// One red-black sweep of grid in place. Each color is shared among the
+// threads and followed by an exchange of the ghost cells on the master
+// thread. With check, returns the max residual of this rank's new values,
+// taken after the final exchange.
+float hybrid_redblack(const FixedCells &fixed_cells, PlateGrid &grid, const LocalBlock &block, int color_offset,
+                      float omega, bool check) {
+    float residual = 0.0f;
+    #pragma omp parallel reduction(max:residual)
+    {
+        int rb, re;
+        thread_share(1, block.rows + 1, rb, re);
+        for (int color = 0; color < 2; color++) {
+            redblack_rows(fixed_cells, grid, rb, re, color_offset, color, omega);
+            #pragma omp barrier
+            #pragma omp master
+            exchange_ghosts(grid, block);
+            #pragma omp barrier
+        }
+        if (check)
+            residual = max_residual_rows(fixed_cells, grid, rb, re);
+    }
+    return residual;
+}
+
+int main(int argc, char* argv[]){
+    // Only the master thread of each rank makes MPI calls.
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if(provided < MPI_THREAD_FUNNELED) {
+        if(rank == 0)
+            cerr << "Error: the MPI library does not support MPI_THREAD_FUNNELED" << endl;
+        MPI_Finalize();
+        return 1;
+    }
+
+    HotplateOptions opts;
+    const char *halo = take_option(argc, argv, "--halo");
+    bool overlap = !halo || strcmp(halo, "sendrecv") != 0;
+    if(!parse_hotplate_options(argc, argv, opts) || argc < 3 ||
+       (halo && strcmp(halo, "overlap") != 0 && strcmp(halo, "sendrecv") != 0)) {
+        if(rank == 0)
+            cout << "Usage: " << argv[0] << " <rows> <cols> [num_threads]" << HOTPLATE_OPTIONS_USAGE
+                 << " [--halo overlap|sendrecv]" << endl;
+        MPI_Finalize();
+        return 1;
+    }
+    if(opts.time_block > 1) {
+        if(rank == 0)
+            cerr << "Error: --time-block is only available in the sequential and OpenMP versions" << endl;
+        MPI_Finalize();
+        return 1;
+    }
+    if(opts.storage != STORAGE_FP32) {
+        if(rank == 0)
+            cerr << "Error: --storage is only available in the sequential and OpenMP versions" << endl;
+        MPI_Finalize();
+        return 1;
+    }
+    if(opts.solver == SOLVER_MULTIGRID) {
+        if(rank == 0)
+            cerr << "Error: --solver multigrid is only available in the sequential and OpenMP versions" << endl;
+        MPI_Finalize();
+        return 1;
+    }
+
+    int global_rows = atoi(argv[1]);
+    int global_cols = atoi(argv[2]);
+    // Threads per rank; OMP_NUM_THREADS when not given.
+    if(argc > 3 && atoi(argv[3]) > 0)
+        omp_set_num_threads(atoi(argv[3]));
+
+    LocalBlock block;
+    if(!create_local_block(global_rows, global_cols, block)) {
+        MPI_Finalize();
+        return 0;
+    }
+    MPI_Comm_rank(block.comm, &rank);
+    int local_rows = block.rows, local_cols = block.cols;
+
+    PlateGrid local_matrix1(local_rows + 2, local_cols + 2);
+    PlateGrid local_matrix2(local_rows + 2, local_cols + 2);
+    initialize_block(local_matrix1, opts.scenario, global_rows, global_cols, block.row_offset, block.col_offset);
+    initialize_block(local_matrix2, opts.scenario, global_rows, global_cols, block.row_offset, block.col_offset);
+    FixedCells fixed_cells = plate_fixed_cells(opts.scenario, global_rows, global_cols, block.row_offset,
+                                               1, local_rows + 1, block.col_offset, 1, local_cols + 1);
+
+    commit_block_column(block, local_matrix1);
+
+    MPI_Barrier(block.comm);
+    double t_start = MPI_Wtime();
+
+    int iter = 0;
+    ConvergenceSchedule schedule(opts);
+    long sweep = 0;
+    bool check;
+
+    PlateGrid* const grids[2] = {&local_matrix1, &local_matrix2};
+    if(opts.restart && (sweep = load_block_checkpoint(opts.checkpoint_path, global_rows, global_cols, opts.solver,
+                                                      block, grids, 2, schedule)) < 0) {
+        free_local_block(block);
+        MPI_Finalize();
+        return 1;
+    }
+    if (opts.red_black())
+        iter = (int) sweep;
+    BlockCheckpointWriter checkpoint(opts, global_rows, global_cols, block, sweep);
+    BlockSnapshot snapshot(opts, global_rows, global_cols, block, sweep);
+
+    exchange_ghosts(local_matrix1, block);
+    if (opts.restart)
+        exchange_ghosts(local_matrix2, block); // an odd sweep resumes from local_matrix2
+
+    if (opts.red_black()) {
+        // Red-black sweeps work on local_matrix1 in place; each one counts.
+        float omega = opts.relaxation(global_rows, global_cols);
+        int color_offset = block.row_offset + block.col_offset;
+        while (true) {
+            check = schedule.due(++sweep);
+            float local_residual = hybrid_redblack(fixed_cells, local_matrix1, block, color_offset, omega, check);
+            iter++;
+            if (snapshot.due(sweep))
+                snapshot.save(sweep, local_matrix1);
+            if (check && global_converged(schedule, sweep, local_residual, block.comm))
+                break;
+            if (checkpoint.due(sweep))
+                checkpoint.save(sweep, schedule, local_matrix1);
+        }
+    } else {
+        while (true) {
+            float local_residual;
+            // After --restart from an odd sweep the cycle resumes at its second
+            // sweep, so the matrices keep their roles; both hold the plate.
+            if (sweep % 2 == 0) {
+                // --- First sweep: update local_matrix2 from local_matrix1 ---
+                check = schedule.due(++sweep);
+                local_residual = hybrid_sweep(fixed_cells, local_matrix1, local_matrix2, block, overlap, check);
+                if (snapshot.due(sweep))
+                    snapshot.save(sweep, local_matrix2);
+                if (check && global_converged(schedule, sweep, local_residual, block.comm))
+                    break;
+                if (checkpoint.due(sweep))
+                    checkpoint.save(sweep, schedule, local_matrix2);
+            }
+
+            // --- Second sweep: update local_matrix1 from local_matrix2 ---
+            check = schedule.due(++sweep);
+            local_residual = hybrid_sweep(fixed_cells, local_matrix2, local_matrix1, block, overlap, check);
+            if (snapshot.due(sweep))
+                snapshot.save(sweep, local_matrix1);
+            if (check && global_converged(schedule, sweep, local_residual, block.comm))
+                break;
+            if (checkpoint.due(sweep))
+                checkpoint.save(sweep, schedule, local_matrix1);
+        }
+        // One iteration per full cycle (both sweeps) before the sweep that
+        // converged, counted from the first sweep even after --restart.
+        iter = (int) ((sweep - 1) / 2);
+    }
+
+    int local_hot = 0;
+    #pragma omp parallel for reduction(+:local_hot) schedule(static)
+    for (int i = 0; i < local_rows + 2; i++)
+        local_hot += block_hot_cells(local_matrix1, block, i);
+
+    int global_hot = 0;
+    MPI_Reduce(&local_hot, &global_hot, 1, MPI_INT, MPI_SUM, 0, block.comm);
+
+    double t_end = MPI_Wtime();
+
+    if(rank == 0) {
+        cout << "N° Iteraciones: " << iter << endl;
+        cout << "Tiempo de ejecucion: " << t_end - t_start << " segundos" << endl;
+        cout << "Num. de celdas calientes: " << global_hot << endl;
+    }
+
+    checkpoint.finish();
+    snapshot.finish();
+    free_local_block(block);
+    MPI_Finalize();
+    return 0;
+}
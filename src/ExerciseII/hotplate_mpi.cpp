@@ -1,253 +1,225 @@
-#include <mpi.h>
-#include <iostream>
-#include <vector>
-#include <cstdlib>
-#include <cmath>
-
-using namespace std;
-
-// Initializes the local portion of the matrix using global indices.
-// The local matrix has dimensions (local_rows+2) x global_cols, where row 0 and row local_rows+1 are ghost rows.
-void initialize_local(int global_rows, int global_cols, int local_start, int local_rows, vector<vector<float>> &mat) {
-    // Initialize only the "actual" rows (indices 1..local_rows)
-    for (int i = 1; i <= local_rows; i++){
-        int global_row = local_start + i - 1;
-        for (int j = 0; j < global_cols; j++){
-            // Apply the boundary conditions using global indices.
-            if (global_row == 0 || j == 0 || j == global_cols - 1) {
-                mat[i][j] = 0.0f; // cold boundary
-            } else if (global_row == global_rows - 1) {
-                mat[i][j] = 100.0f; // hot border
-            } else if (global_row == 400 || j < 500) {
-                mat[i][j] = 100.0f; // hot region (as in your original code)
-            } else if (global_row == 512 && j == 512) {
-                mat[i][j] = 100.0f; // hot center
-            } else {
-                mat[i][j] = 0.0f;
-            }
-        }
-    }
-}
-
-int main(int argc, char* argv[]){
-    MPI_Init(&argc, &argv);
-    
-    int rank, nprocs;
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
-    
-    if(argc < 3) {
-        if(rank == 0)
-            cout << "Usage: " << argv[0] << " <rows> <cols>" << endl;
-        MPI_Finalize();
-        return 1;
-    }
-    
-    int global_rows = atoi(argv[1]);
-    int global_cols = atoi(argv[2]);
-    
-    // Distribute the global rows among processes.
-    // Each process will get a contiguous block of rows.
-    int rows_per_proc = global_rows / nprocs;
-    int remainder = global_rows % nprocs;
-    
-    // Each process gets an extra row if its rank is less than remainder.
-    int local_rows = rows_per_proc + (rank < remainder ? 1 : 0);
-    
-    // Compute the starting global row index for this process.
-    int local_start;
-    if(rank < remainder)
-        local_start = rank * (rows_per_proc + 1);
-    else
-        local_start = rank * rows_per_proc + remainder;
-    
-    // Allocate local matrices with two extra ghost rows:
-    // Row 0 and row local_rows+1 are used for ghost data.
-    vector<vector<float>> local_matrix1(local_rows + 2, vector<float>(global_cols, 0));
-    vector<vector<float>> local_matrix2(local_rows + 2, vector<float>(global_cols, 0));
-    
-    // Initialize the actual local subdomain (rows 1..local_rows) using the global index.
-    initialize_local(global_rows, global_cols, local_start, local_rows, local_matrix1);
-    initialize_local(global_rows, global_cols, local_start, local_rows, local_matrix2);
-    
-    // For processes that are at the global boundaries, set the ghost rows according to the fixed boundary conditions.
-    if(rank == 0) {
-        for (int j = 0; j < global_cols; j++){
-            local_matrix1[0][j] = 0.0f;
-            local_matrix2[0][j] = 0.0f;
-        }
-    }
-    if(rank == nprocs - 1) {
-        for (int j = 0; j < global_cols; j++){
-            local_matrix1[local_rows+1][j] = 100.0f;
-            local_matrix2[local_rows+1][j] = 100.0f;
-        }
-    }
-    
-    MPI_Barrier(MPI_COMM_WORLD);
-    double t_start = MPI_Wtime();
-    
-    bool global_done = false;
-    int iter = 0;
-    
-    while (!global_done) {
-        // --- Exchange ghost rows for matrix1 before first sweep ---
-        // If not the top process, send first actual row upward and receive ghost row.
-        if(rank > 0) {
-            MPI_Sendrecv(&local_matrix1[1][0], global_cols, MPI_FLOAT, rank-1, 0,
-                         &local_matrix1[0][0], global_cols, MPI_FLOAT, rank-1, 0,
-                         MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        }
-        // If not the bottom process, send last actual row downward and receive ghost row.
-        if(rank < nprocs - 1) {
-            MPI_Sendrecv(&local_matrix1[local_rows][0], global_cols, MPI_FLOAT, rank+1, 0,
-                         &local_matrix1[local_rows+1][0], global_cols, MPI_FLOAT, rank+1, 0,
-                         MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        }
-        
-        // --- First sweep: update local_matrix2 from local_matrix1 ---
-        for (int i = 1; i <= local_rows; i++){
-            int global_row = local_start + i - 1;
-            // Skip updating the global boundaries.
-            if (global_row == 0 || global_row == global_rows - 1)
-                continue;
-            for (int j = 1; j < global_cols - 1; j++){
-                // Skip fixed hot cells.
-                if ((global_row == 500 && j < 400) || (global_row == 512 && j == 512))
-                    continue;
-                local_matrix2[i][j] = (local_matrix1[i+1][j] + local_matrix1[i-1][j] +
-                                       local_matrix1[i][j+1] + local_matrix1[i][j-1] +
-                                       4 * local_matrix1[i][j]) / 8.0f;
-            }
-        }
-        
-        // --- Exchange ghost rows for matrix2 ---
-        if(rank > 0) {
-            MPI_Sendrecv(&local_matrix2[1][0], global_cols, MPI_FLOAT, rank-1, 0,
-                         &local_matrix2[0][0], global_cols, MPI_FLOAT, rank-1, 0,
-                         MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        }
-        if(rank < nprocs - 1) {
-            MPI_Sendrecv(&local_matrix2[local_rows][0], global_cols, MPI_FLOAT, rank+1, 0,
-                         &local_matrix2[local_rows+1][0], global_cols, MPI_FLOAT, rank+1, 0,
-                         MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        }
-        
-        // --- Convergence check on local_matrix2 ---
-        bool local_converged = true;
-        for (int i = 1; i <= local_rows; i++){
-            int global_row = local_start + i - 1;
-            if (global_row == 0 || global_row == global_rows - 1)
-                continue;
-            for (int j = 1; j < global_cols - 1; j++){
-                if ((global_row == 500 && j < 400) || (global_row == 512 && j == 512))
-                    continue;
-                float conv = local_matrix2[i][j] - ((local_matrix2[i+1][j] + local_matrix2[i-1][j] +
-                                                     local_matrix2[i][j+1] + local_matrix2[i][j-1]) / 4.0f);
-                if (fabs(conv) > 0.1f) {
-                    local_converged = false;
-                    break;
-                }
-            }
-            if (!local_converged)
-                break;
-        }
-        
-        int local_flag = local_converged ? 1 : 0;
-        int global_flag;
-        MPI_Allreduce(&local_flag, &global_flag, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
-        if (global_flag == 1) {
-            global_done = true;
-            break;
-        }
-        
-        // --- Exchange ghost rows for matrix2 before second sweep ---
-        if(rank > 0) {
-            MPI_Sendrecv(&local_matrix2[1][0], global_cols, MPI_FLOAT, rank-1, 0,
-                         &local_matrix2[0][0], global_cols, MPI_FLOAT, rank-1, 0,
-                         MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        }
-        if(rank < nprocs - 1) {
-            MPI_Sendrecv(&local_matrix2[local_rows][0], global_cols, MPI_FLOAT, rank+1, 0,
-                         &local_matrix2[local_rows+1][0], global_cols, MPI_FLOAT, rank+1, 0,
-                         MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        }
-        
-        // --- Second sweep: update local_matrix1 from local_matrix2 ---
-        for (int i = 1; i <= local_rows; i++){
-            int global_row = local_start + i - 1;
-            if (global_row == 0 || global_row == global_rows - 1)
-                continue;
-            for (int j = 1; j < global_cols - 1; j++){
-                if ((global_row == 500 && j < 400) || (global_row == 512 && j == 512))
-                    continue;
-                local_matrix1[i][j] = (local_matrix2[i+1][j] + local_matrix2[i-1][j] +
-                                       local_matrix2[i][j+1] + local_matrix2[i][j-1] +
-                                       4 * local_matrix2[i][j]) / 8.0f;
-            }
-        }
-        
-        // --- Exchange ghost rows for matrix1 ---
-        if(rank > 0) {
-            MPI_Sendrecv(&local_matrix1[1][0], global_cols, MPI_FLOAT, rank-1, 0,
-                         &local_matrix1[0][0], global_cols, MPI_FLOAT, rank-1, 0,
-                         MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        }
-        if(rank < nprocs - 1) {
-            MPI_Sendrecv(&local_matrix1[local_rows][0], global_cols, MPI_FLOAT, rank+1, 0,
-                         &local_matrix1[local_rows+1][0], global_cols, MPI_FLOAT, rank+1, 0,
-                         MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        }
-        
-        // --- Convergence check on local_matrix1 ---
-        local_converged = true;
-        for (int i = 1; i <= local_rows; i++){
-            int global_row = local_start + i - 1;
-            if (global_row == 0 || global_row == global_rows - 1)
-                continue;
-            for (int j = 1; j < global_cols - 1; j++){
-                if ((global_row == 500 && j < 400) || (global_row == 512 && j == 512))
-                    continue;
-                float conv = local_matrix1[i][j] - ((local_matrix1[i+1][j] + local_matrix1[i-1][j] +
-                                                     local_matrix1[i][j+1] + local_matrix1[i][j-1]) / 4.0f);
-                if (fabs(conv) > 0.1f) {
-                    local_converged = false;
-                    break;
-                }
-            }
-            if (!local_converged)
-                break;
-        }
-        local_flag = local_converged ? 1 : 0;
-        MPI_Allreduce(&local_flag, &global_flag, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
-        if (global_flag == 1) {
-            global_done = true;
-            break;
-        }
-        
-        iter++;
-    }
-    
-    // Count hot cells in the local domain.
-    int local_hot = 0;
-    for (int i = 1; i <= local_rows; i++){
-        for (int j = 0; j < global_cols; j++){
-            if (local_matrix1[i][j] > 50.0f)
-                local_hot++;
-        }
-    }
-    
-    int global_hot = 0;
-    MPI_Reduce(&local_hot, &global_hot, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-    
-    double t_end = MPI_Wtime();
-    
-    if(rank == 0) {
-        cout << "N° Iteraciones: " << iter << endl;
-	cout << "Tiempo de ejecucion: " << t_end - t_start << " segundos" << endl;
-	cout << "Num. de celdas calientes: " << global_hot << endl;
-    }
-    
-    MPI_Finalize();
-    return 0;
-}
+#include <mpi.h>
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "hotplate_checkpoint_mpi.h"
+#include "hotplate_grid.h"
+#include "hotplate_halo.h"
+#include "hotplate_options.h"
+#include "hotplate_snapshot_mpi.h"
+
+using namespace std;
+
+// One Jacobi sweep of dst from src (whose ghost cells are current) that
+// leaves the ghost cells of dst current too, so each sweep needs a single
+// exchange. With overlap the edge rows and columns, the cells the neighbours
+// need, are computed first and sent while the core of the block is updated;
+// the residual of the frame next to the ghost cells is taken after
+// MPI_Waitall. Without overlap the sweep is followed by a blocking exchange.
+// With check, returns the max residual of this rank's new values.
+float halo_sweep(const FixedCells &fixed_cells, const PlateGrid &src, PlateGrid &dst, const LocalBlock &block,
+                 bool overlap, bool check) {
+    int lr = block.rows, lc = block.cols;
+    if (!overlap || lr < 3 || lc < 3) {
+        // The residual reads the ghost columns, so it waits for the exchange.
+        sweep_rows(fixed_cells, src, dst, 1, lr + 1, false);
+        sendrecv_ghosts(dst, block);
+        return check ? max_residual_rows(fixed_cells, dst, 1, lr + 1) : 0.0f;
+    }
+    
+    sweep_rows(fixed_cells, src, dst, 1, 2, false);
+    sweep_rows(fixed_cells, src, dst, lr, lr + 1, false);
+    sweep_rows(fixed_cells, src, dst, 2, lr, false, 1, 2);
+    sweep_rows(fixed_cells, src, dst, 2, lr, false, lc, lc + 1);
+    MPI_Request req[8];
+    start_ghost_exchange(dst, block, req);
+    
+    // The core, rows 2..lr-1 by columns 2..lc-1, reads no ghost cells.
+    float residual = sweep_rows(fixed_cells, src, dst, 2, lr, check, 2, lc);
+    if (check)
+        residual = max(residual, edge_max_residual(fixed_cells, dst, 2, lr, 2, lc));
+    
+    MPI_Waitall(8, req, MPI_STATUSES_IGNORE);
+    if (check) {
+        residual = max(residual, edge_max_residual(fixed_cells, dst, 1, lr + 1));
+        residual = max(residual, max_residual_rows(fixed_cells, dst, 2, lr, 1, 2));
+        residual = max(residual, max_residual_rows(fixed_cells, dst, 2, lr, lc, lc + 1));
+    }
+    return residual;
+}
+
+int main(int argc, char* argv[]){
+    MPI_Init(&argc, &argv);
+    
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    
+    HotplateOptions opts;
+    // Halo exchange of the Jacobi sweeps: overlapped with the update
+    // (default) or blocking after it.
+    const char *halo = take_option(argc, argv, "--halo");
+    bool overlap = !halo || strcmp(halo, "sendrecv") != 0;
+    if(!parse_hotplate_options(argc, argv, opts) || argc < 3 ||
+       (halo && strcmp(halo, "overlap") != 0 && strcmp(halo, "sendrecv") != 0)) {
+        if(rank == 0)
+            cout << "Usage: " << argv[0] << " <rows> <cols>" << HOTPLATE_OPTIONS_USAGE
+                 << " [--halo overlap|sendrecv]" << endl;
+        MPI_Finalize();
+        return 1;
+    }
+    if(opts.time_block > 1) {
+        if(rank == 0)
+            cerr << "Error: --time-block is only available in the sequential and OpenMP versions" << endl;
+        MPI_Finalize();
+        return 1;
+    }
+    if(opts.storage != STORAGE_FP32) {
+        if(rank == 0)
+            cerr << "Error: --storage is only available in the sequential and OpenMP versions" << endl;
+        MPI_Finalize();
+        return 1;
+    }
+    if(opts.solver == SOLVER_MULTIGRID) {
+        if(rank == 0)
+            cerr << "Error: --solver multigrid is only available in the sequential and OpenMP versions" << endl;
+        MPI_Finalize();
+        return 1;
+    }
+    
+    int global_rows = atoi(argv[1]);
+    int global_cols = atoi(argv[2]);
+    
+    // Arrange the processes in a 2D grid and give each a block of the
+    // interior cells; the plate's border lives in the ghost cells of the
+    // blocks along its edge.
+    LocalBlock block;
+    if(!create_local_block(global_rows, global_cols, block)) {
+        MPI_Finalize();
+        return 0;
+    }
+    MPI_Comm_rank(block.comm, &rank);
+    int local_rows = block.rows, local_cols = block.cols;
+    
+    // Allocate local matrices with a ring of ghost cells and fill them,
+    // ghosts included, with the initial plate.
+    PlateGrid local_matrix1(local_rows + 2, local_cols + 2);
+    PlateGrid local_matrix2(local_rows + 2, local_cols + 2);
+    initialize_block(local_matrix1, opts.scenario, global_rows, global_cols, block.row_offset, block.col_offset);
+    initialize_block(local_matrix2, opts.scenario, global_rows, global_cols, block.row_offset, block.col_offset);
+    FixedCells fixed_cells = plate_fixed_cells(opts.scenario, global_rows, global_cols, block.row_offset,
+                                               1, local_rows + 1, block.col_offset, 1, local_cols + 1);
+    
+    commit_block_column(block, local_matrix1);
+    
+    MPI_Barrier(block.comm);
+    double t_start = MPI_Wtime();
+    
+    int iter = 0;
+    // Every rank sees the same global residuals, so the schedules stay in step.
+    ConvergenceSchedule schedule(opts);
+    long sweep = 0;
+    bool check;
+    
+    // --restart continues from the sweep of the checkpoint, with both
+    // matrices holding its plate.
+    PlateGrid* const grids[2] = {&local_matrix1, &local_matrix2};
+    if(opts.restart && (sweep = load_block_checkpoint(opts.checkpoint_path, global_rows, global_cols, opts.solver,
+                                                      block, grids, 2, schedule)) < 0) {
+        free_local_block(block);
+        MPI_Finalize();
+        return 1;
+    }
+    if (opts.red_black())
+        iter = (int) sweep;
+    BlockCheckpointWriter checkpoint(opts, global_rows, global_cols, block, sweep);
+    BlockSnapshot snapshot(opts, global_rows, global_cols, block, sweep);
+    
+    // Ghost cells of the initial plate; from here on every update of a
+    // matrix is followed by the exchange of its ghost cells.
+    exchange_ghosts(local_matrix1, block);
+    if (opts.restart)
+        exchange_ghosts(local_matrix2, block); // an odd sweep resumes from local_matrix2
+    
+    if (opts.red_black()) {
+        // Red-black sweeps work on local_matrix1 in place. Each color reads
+        // the other color of the ghost cells, so they are exchanged after each.
+        // The color of a cell depends on its global row + column.
+        float omega = opts.relaxation(global_rows, global_cols);
+        int color_offset = block.row_offset + block.col_offset;
+        while (true) {
+            check = schedule.due(++sweep);
+            redblack_rows(fixed_cells, local_matrix1, 1, local_rows + 1, color_offset, 0, omega);
+            exchange_ghosts(local_matrix1, block);
+            redblack_rows(fixed_cells, local_matrix1, 1, local_rows + 1, color_offset, 1, omega);
+            exchange_ghosts(local_matrix1, block);
+            iter++;
+            if (snapshot.due(sweep))
+                snapshot.save(sweep, local_matrix1);
+            
+            // The cells next to the ghost columns need the neighbours' last
+            // color too, so the residual is taken after the exchange.
+            if (check && global_converged(schedule, sweep, max_residual_rows(fixed_cells, local_matrix1, 1, local_rows + 1),
+                                          block.comm))
+                break;
+            if (checkpoint.due(sweep))
+                checkpoint.save(sweep, schedule, local_matrix1);
+        }
+    } else {
+        while (true) {
+            float local_residual;
+            // After --restart from an odd sweep the cycle resumes at its second
+            // sweep, so the matrices keep their roles; both hold the plate.
+            if (sweep % 2 == 0) {
+                // --- First sweep: update local_matrix2 from local_matrix1 ---
+                check = schedule.due(++sweep);
+                local_residual = halo_sweep(fixed_cells, local_matrix1, local_matrix2, block, overlap, check);
+                if (snapshot.due(sweep))
+                    snapshot.save(sweep, local_matrix2);
+                if (check && global_converged(schedule, sweep, local_residual, block.comm))
+                    break;
+                if (checkpoint.due(sweep))
+                    checkpoint.save(sweep, schedule, local_matrix2);
+            }
+            
+            // --- Second sweep: update local_matrix1 from local_matrix2 ---
+            check = schedule.due(++sweep);
+            local_residual = halo_sweep(fixed_cells, local_matrix2, local_matrix1, block, overlap, check);
+            if (snapshot.due(sweep))
+                snapshot.save(sweep, local_matrix1);
+            if (check && global_converged(schedule, sweep, local_residual, block.comm))
+                break;
+            if (checkpoint.due(sweep))
+                checkpoint.save(sweep, schedule, local_matrix1);
+        }
+        // One iteration per full cycle (both sweeps) before the sweep that
+        // converged, counted from the first sweep even after --restart.
+        iter = (int) ((sweep - 1) / 2);
+    }
+    
+    // Count hot cells in the local block, plus the border cells held in the
+    // ghost cells along the plate's edge.
+    int local_hot = 0;
+    for (int i = 0; i < local_rows + 2; i++)
+        local_hot += block_hot_cells(local_matrix1, block, i);
+    
+    int global_hot = 0;
+    MPI_Reduce(&local_hot, &global_hot, 1, MPI_INT, MPI_SUM, 0, block.comm);
+    
+    double t_end = MPI_Wtime();
+    
+    if(rank == 0) {
+        cout << "N° Iteraciones: " << iter << endl;
+	cout << "Tiempo de ejecucion: " << t_end - t_start << " segundos" << endl;
+	cout << "Num. de celdas calientes: " << global_hot << endl;
+    }
+    
+    checkpoint.finish();
+    snapshot.finish();
+    free_local_block(block);
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,233 @@
+#ifndef HOTPLATE_MULTIGRID_H
+#define HOTPLATE_MULTIGRID_H
+
+// Geometric multigrid for the steady state of the hotplate.
+//
+// The converged plate solves the Laplace equation 4u - (n+s+e+w) = 0 on the
+// free cells, with the plate border and the fixed cells as Dirichlet values.
+// Relaxation only removes the error that varies from cell to cell quickly;
+// the smooth error left behind is solved for on a grid with half the cells
+// per side, recursively, and the correction is interpolated back:
+//
+//   1. a few red-black Gauss-Seidel sweeps of the plate (redblack_rows());
+//   2. the residual r = (n+s+e+w) - 4u is restricted by full weighting to
+//      the coarse grid, where the correction e solves 4e - (n+s+e+w) = 4r
+//      (the coarse cells are twice as wide) with e = 0 on the border and on
+//      coarse cells next to a fixed cell, and the same cycle is applied;
+//   3. e is interpolated bilinearly and added to the free cells of the plate,
+//      followed by a few more sweeps.
+//
+// A V-cycle visits each coarse level once, a W-cycle twice. Every cycle
+// costs a fixed number of passes over the plate plus a third for the coarse
+// levels, and cuts the error by a factor that does not depend on the plate
+// size, so the time to reach the tolerance grows linearly with the cells.
+//
+// Coarse cell (i, j) sits on fine cell (2i, 2j). Level k of a plate with n
+// rows has its border row at round((n-1) / 2^k), the closest to the real
+// border, so when (n-1) / 2^(k-1) is odd the coarse border falls half a coarse
+// cell outside or inside the fine one. Sizing each level from its parent
+// instead would let those offsets add up over the levels, and a coarse
+// domain that is too large overshoots the correction until V-cycles diverge.
+// The same goes for the columns.
+//
+// The cycle functions must be called either outside any parallel region or
+// by every thread of one: their loops are shared out with orphaned
+// "omp for" constructs, whose implicit barriers order the phases.
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "hotplate_grid.h"
+
+#ifdef _OPENMP
+#define HOTPLATE_OMP_FOR _Pragma("omp for schedule(static)")
+#else
+#define HOTPLATE_OMP_FOR
+#endif
+
+// Gauss-Seidel sweeps before and after the coarse correction, and on the
+// coarsest grid, which has at most 8 cells on a side.
+const int MULTIGRID_PRE_SWEEPS = 2;
+const int MULTIGRID_POST_SWEEPS = 2;
+const int MULTIGRID_COARSEST_SWEEPS = 20;
+
+struct MultigridLevel {
+    int rows, cols;
+    PlateGrid e; // correction (unused on level 0, which works on the plate)
+    PlateGrid f; // right-hand side (unused on level 0, where it is 0)
+    PlateGrid r; // residual
+    std::vector<unsigned char> held; // rows * cols; 1 where the interior value is kept
+};
+
+class Multigrid {
+public:
+    // cycles_per_level is 1 for V-cycles, 2 for W-cycles.
+    Multigrid(const FixedCells &fixed, int rows, int cols, int cycles_per_level)
+        : fixed(fixed), gamma(cycles_per_level) {
+        levels.emplace_back();
+        MultigridLevel &top = levels.back();
+        top.rows = rows;
+        top.cols = cols;
+        top.r.allocate(rows, cols);
+        top.held.assign((size_t) rows * cols, 0);
+        for (size_t k = 0; k < fixed.size(); k++)
+            top.held[(size_t) fixed.rows[k] * cols + fixed.cols[k]] = 1;
+
+        double scale = 1.0;
+        while (std::min(levels.back().rows, levels.back().cols) > 8) {
+            const MultigridLevel &fine = levels.back();
+            MultigridLevel coarse;
+            scale *= 2.0;
+            coarse.rows = (int) floor((rows - 1) / scale + 0.5) + 1;
+            coarse.cols = (int) floor((cols - 1) / scale + 0.5) + 1;
+            coarse.e.allocate(coarse.rows, coarse.cols);
+            coarse.f.allocate(coarse.rows, coarse.cols);
+            coarse.r.allocate(coarse.rows, coarse.cols);
+            coarse.held.assign((size_t) coarse.rows * coarse.cols, 0);
+            // A coarse cell is held when a held fine cell lies within one
+            // fine cell of it, so fixed rows and points survive coarsening.
+            for (int i = 1; i < coarse.rows - 1; i++)
+                for (int j = 1; j < coarse.cols - 1; j++)
+                    for (int fi = std::max(1, 2*i - 1); fi <= std::min(fine.rows - 2, 2*i + 1); fi++)
+                        for (int fj = std::max(1, 2*j - 1); fj <= std::min(fine.cols - 2, 2*j + 1); fj++)
+                            if (fine.held[(size_t) fi * fine.cols + fj])
+                                coarse.held[(size_t) i * coarse.cols + j] = 1;
+            levels.push_back(std::move(coarse));
+        }
+    }
+
+    int depth() const { return (int) levels.size(); }
+
+    // One cycle on the plate.
+    void cycle(PlateGrid &plate) {
+        if (levels.size() == 1) {
+            for (int s = 0; s < MULTIGRID_COARSEST_SWEEPS; s++)
+                smooth_plate(plate);
+            return;
+        }
+        for (int s = 0; s < MULTIGRID_PRE_SWEEPS; s++)
+            smooth_plate(plate);
+        plate_residual(plate);
+        restrict_residual(0);
+        for (int g = 0; g < gamma; g++)
+            correct(1);
+        prolong(1, plate);
+        for (int s = 0; s < MULTIGRID_POST_SWEEPS; s++)
+            smooth_plate(plate);
+    }
+
+private:
+    const FixedCells &fixed;
+    int gamma;
+    std::vector<MultigridLevel> levels;
+
+    // Solves level l's correction equation approximately, starting from its
+    // current e.
+    void correct(int l) {
+        if (l == depth() - 1) {
+            for (int s = 0; s < MULTIGRID_COARSEST_SWEEPS; s++)
+                smooth(l);
+            return;
+        }
+        for (int s = 0; s < MULTIGRID_PRE_SWEEPS; s++)
+            smooth(l);
+        residual(l);
+        restrict_residual(l);
+        for (int g = 0; g < gamma; g++)
+            correct(l + 1);
+        prolong(l + 1, levels[l].e);
+        for (int s = 0; s < MULTIGRID_POST_SWEEPS; s++)
+            smooth(l);
+    }
+
+    void smooth_plate(PlateGrid &plate) {
+        for (int color = 0; color < 2; color++) {
+            HOTPLATE_OMP_FOR
+            for (int i = 1; i < plate.rows() - 1; i++)
+                redblack_rows(fixed, plate, i, i + 1, 0, color, 1.0f);
+        }
+    }
+
+    // One red-black Gauss-Seidel sweep of 4e - (n+s+e+w) = f.
+    void smooth(int l) {
+        MultigridLevel &L = levels[l];
+        for (int color = 0; color < 2; color++) {
+            HOTPLATE_OMP_FOR
+            for (int i = 1; i < L.rows - 1; i++) {
+                float *e = L.e.row(i);
+                const float *up = L.e.row(i - 1), *down = L.e.row(i + 1), *f = L.f.row(i);
+                const unsigned char *held = &L.held[(size_t) i * L.cols];
+                for (int j = 2 - ((i + color) & 1); j < L.cols - 1; j += 2)
+                    if (!held[j])
+                        e[j] = (up[j] + down[j] + e[j-1] + e[j+1] + f[j]) * 0.25f;
+            }
+        }
+    }
+
+    void plate_residual(const PlateGrid &plate) {
+        MultigridLevel &L = levels[0];
+        HOTPLATE_OMP_FOR
+        for (int i = 1; i < L.rows - 1; i++) {
+            const float *u = plate.row(i), *up = plate.row(i - 1), *down = plate.row(i + 1);
+            const unsigned char *held = &L.held[(size_t) i * L.cols];
+            float *r = L.r.row(i);
+            for (int j = 1; j < L.cols - 1; j++)
+                r[j] = held[j] ? 0.0f : up[j] + down[j] + u[j-1] + u[j+1] - 4.0f * u[j];
+        }
+    }
+
+    void residual(int l) {
+        MultigridLevel &L = levels[l];
+        HOTPLATE_OMP_FOR
+        for (int i = 1; i < L.rows - 1; i++) {
+            const float *e = L.e.row(i), *up = L.e.row(i - 1), *down = L.e.row(i + 1), *f = L.f.row(i);
+            const unsigned char *held = &L.held[(size_t) i * L.cols];
+            float *r = L.r.row(i);
+            for (int j = 1; j < L.cols - 1; j++)
+                r[j] = held[j] ? 0.0f : f[j] + up[j] + down[j] + e[j-1] + e[j+1] - 4.0f * e[j];
+        }
+    }
+
+    // Full weighting of level l's residual into the right-hand side of level
+    // l+1, whose correction starts from 0.
+    void restrict_residual(int l) {
+        const MultigridLevel &F = levels[l];
+        MultigridLevel &C = levels[l + 1];
+        HOTPLATE_OMP_FOR
+        for (int i = 1; i < C.rows - 1; i++) {
+            const float *up = F.r.row(2*i - 1), *mid = F.r.row(2*i), *down = F.r.row(2*i + 1);
+            const unsigned char *held = &C.held[(size_t) i * C.cols];
+            float *f = C.f.row(i), *e = C.e.row(i);
+            for (int j = 1; j < C.cols - 1; j++) {
+                int fj = 2 * j;
+                float w = 4.0f * mid[fj] + 2.0f * (up[fj] + down[fj] + mid[fj-1] + mid[fj+1])
+                        + up[fj-1] + up[fj+1] + down[fj-1] + down[fj+1];
+                // (w / 16) scaled by 4 for the coarse cell width.
+                f[j] = held[j] ? 0.0f : 0.25f * w;
+                e[j] = 0.0f;
+            }
+        }
+    }
+
+    // Adds the bilinear interpolation of level l's correction to the free
+    // interior cells of target, which has the size of level l-1.
+    void prolong(int l, PlateGrid &target) {
+        const MultigridLevel &C = levels[l];
+        const MultigridLevel &F = levels[l - 1];
+        HOTPLATE_OMP_FOR
+        for (int i = 1; i < F.rows - 1; i++) {
+            const float *c0 = C.e.row(i / 2), *c1 = C.e.row((i + 1) / 2);
+            const unsigned char *held = &F.held[(size_t) i * F.cols];
+            float *t = target.row(i);
+            for (int j = 1; j < F.cols - 1; j++) {
+                if (held[j])
+                    continue;
+                int a = j / 2, b = (j + 1) / 2;
+                t[j] += 0.25f * (c0[a] + c0[b] + c1[a] + c1[b]);
+            }
+        }
+    }
+};
+
+#endif
@@ -1,128 +1,377 @@
-#include <iostream>
-#include <vector>
-#include <cstdlib>
-#include <cmath>
-#include <chrono>
-#include <omp.h>
-
-using namespace std;
-
-void initialize(int row, int col, vector<vector<float>> &mat) {
-    for (int i = 0; i < row; i++){
-        for (int j = 0; j < col; j++){
-            if (i == 0 || j == 0 || j == col - 1) {
-                mat[i][j] = 0.0f; // cold boundary
-            } else if (i == row - 1) {
-                mat[i][j] = 100.0f; // hot border
-            } else if (i == 400 || j < 500) { // hot region condition (per your code)
-                mat[i][j] = 100.0f;
-            } else if (i == 512 && j == 512) {
-                mat[i][j] = 100.0f; // hot center
-            } else {
-                mat[i][j] = 0.0f;
-            }
-        }
-    }
-}
-
-int main(int argc, char* argv[]){
-    if (argc < 3) {
-        cerr << "Usage: " << argv[0] << " <rows> <cols>" << endl;
-        return 1;
-    }
-
-    int row = atoi(argv[1]);
-    int col = atoi(argv[2]);
-    int iter = 0;
-
-    // Create two matrices with the given number of rows and columns.
-    vector<vector<float>> matrix1(row, vector<float>(col, 0));
-    vector<vector<float>> matrix2(row, vector<float>(col, 0));
-
-    // Initialize both matrices.
-    initialize(row, col, matrix1);
-    initialize(row, col, matrix2);
-
-    auto t_start = chrono::high_resolution_clock::now();
-
-    while (true) {
-        // First sweep: update matrix2 from matrix1
-        #pragma omp parallel for collapse(2) schedule(static)
-        for (int i = 1; i < row - 1; i++){
-            for (int j = 1; j < col - 1; j++){
-                // Skip fixed hot cells.
-                if ((i == 500 && j < 400) || (i == 512 && j == 512))
-                    continue;
-                matrix2[i][j] = (matrix1[i+1][j] + matrix1[i-1][j] +
-                                 matrix1[i][j+1] + matrix1[i][j-1] +
-                                 4 * matrix1[i][j]) / 8.0f;
-            }
-        }
-        // Implicit barrier at end of parallel region
-
-        // Convergence check for matrix2
-        int conv_flag = 0;
-        #pragma omp parallel for collapse(2) reduction(+:conv_flag) schedule(static)
-        for (int i = 1; i < row - 1; i++){
-            for (int j = 1; j < col - 1; j++){
-                if ((i == 500 && j < 400) || (i == 512 && j == 512))
-                    continue;
-                float conv = matrix2[i][j] - ((matrix2[i+1][j] + matrix2[i-1][j] +
-                                               matrix2[i][j+1] + matrix2[i][j-1]) / 4.0f);
-                if (fabs(conv) > 0.1f)
-                    conv_flag++;
-            }
-        }
-        if (conv_flag == 0)
-            break;
-
-        // Second sweep: update matrix1 from matrix2
-        #pragma omp parallel for collapse(2) schedule(static)
-        for (int i = 1; i < row - 1; i++){
-            for (int j = 1; j < col - 1; j++){
-                if ((i == 500 && j < 400) || (i == 512 && j == 512))
-                    continue;
-                matrix1[i][j] = (matrix2[i+1][j] + matrix2[i-1][j] +
-                                 matrix2[i][j+1] + matrix2[i][j-1] +
-                                 4 * matrix2[i][j]) / 8.0f;
-            }
-        }
-
-        // Convergence check for matrix1
-        conv_flag = 0;
-        #pragma omp parallel for collapse(2) reduction(+:conv_flag) schedule(static)
-        for (int i = 1; i < row - 1; i++){
-            for (int j = 1; j < col - 1; j++){
-                if ((i == 500 && j < 400) || (i == 512 && j == 512))
-                    continue;
-                float conv = matrix1[i][j] - ((matrix1[i+1][j] + matrix1[i-1][j] +
-                                               matrix1[i][j+1] + matrix1[i][j-1]) / 4.0f);
-                if (fabs(conv) > 0.1f)
-                    conv_flag++;
-            }
-        }
-        if (conv_flag == 0)
-            break;
-
-        iter++; // One full cycle (both sweeps)
-    }
-
-    auto t_end = chrono::high_resolution_clock::now();
-    double exec_time = chrono::duration<double>(t_end - t_start).count();
-
-    // Count hot cells (using parallel reduction)
-    int hot_cells = 0;
-    #pragma omp parallel for collapse(2) reduction(+:hot_cells) schedule(static)
-    for (int i = 0; i < row; i++){
-        for (int j = 0; j < col; j++){
-            if (matrix1[i][j] > 50.0f)
-                hot_cells++;
-        }
-    }
-
-    cout << "N° Iteraciones: " << iter << endl;
-    cout << "Tiempo de ejecucion: " << exec_time << " segundos" << endl;
-    cout << "Num. de celdas calientes: " << hot_cells << endl;
-
-    return 0;
-}
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <omp.h>
+
+#include "hotplate_grid.h"
+#include "hotplate_blocking.h"
+#include "hotplate_checkpoint.h"
+#include "hotplate_multigrid.h"
+#include "hotplate_options.h"
+#include "hotplate_precision.h"
+#include "hotplate_snapshot.h"
+
+using namespace std;
+
+// Contiguous share of rows [begin, end) for the calling thread; the fused
+// sweep needs whole blocks of rows rather than interleaved ones.
+void thread_rows(int begin, int end, int &rb, int &re) {
+    int nthreads = omp_get_num_threads(), tid = omp_get_thread_num();
+    int n = end - begin;
+    rb = begin + (int) ((long long) n * tid / nthreads);
+    re = begin + (int) ((long long) n * (tid + 1) / nthreads);
+}
+
+// Updates dst from src. With check, returns the max residual of the new
+// values; the rows at the block edges are checked after the barrier, once the
+// neighbouring blocks are written.
+float parallel_sweep(const FixedCells &fixed_cells, const PlateGrid &src, PlateGrid &dst, bool check) {
+    float residual = 0.0f;
+    #pragma omp parallel reduction(max:residual)
+    {
+        int rb, re;
+        thread_rows(1, src.rows() - 1, rb, re);
+        residual = sweep_rows(fixed_cells, src, dst, rb, re, check);
+        if (check) {
+            #pragma omp barrier
+            residual = max(residual, edge_max_residual(fixed_cells, dst, rb, re));
+        }
+    }
+    return residual;
+}
+
+// One red-black sweep of grid in place, each color split among the threads.
+// With check, returns the max residual of the new values.
+float parallel_redblack(const FixedCells &fixed_cells, PlateGrid &grid, float omega, bool check) {
+    float residual = 0.0f;
+    #pragma omp parallel reduction(max:residual)
+    {
+        int rb, re;
+        thread_rows(1, grid.rows() - 1, rb, re);
+        redblack_rows(fixed_cells, grid, rb, re, 0, 0, omega);
+        #pragma omp barrier
+        residual = redblack_rows(fixed_cells, grid, rb, re, 0, 1, omega, check);
+        if (check) {
+            #pragma omp barrier
+            residual = max(residual, edge_max_residual(fixed_cells, grid, rb, re));
+        }
+    }
+    return residual;
+}
+
+// parallel_sweep() on 16-bit grids.
+float parallel_half_sweep(const FixedCells &fixed_cells, const HalfGrid &src, HalfGrid &dst, bool check) {
+    float residual = 0.0f;
+    #pragma omp parallel reduction(max:residual)
+    {
+        int rb, re;
+        thread_rows(1, src.rows() - 1, rb, re);
+        residual = half_sweep_rows(fixed_cells, src, dst, rb, re, check);
+        if (check) {
+            #pragma omp barrier
+            residual = max(residual, half_edge_max_residual(fixed_cells, dst, rb, re));
+        }
+    }
+    return residual;
+}
+
+// Jacobi sweeps on 16-bit copies of the plate in grids[0], until the schedule
+// hands over to fp32; sweep s writes halves[s % 2]. The plate of the last sweep
+// is widened into grids[s % 2]. Returns the number of sweeps.
+long low_precision_sweeps(PlateGrid* const grids[2], const FixedCells &fixed_cells, const HotplateOptions &opts) {
+    int row = grids[0]->rows(), col = grids[0]->cols();
+    HalfGrid half1(row, col, opts.storage);
+    HalfGrid half2(row, col, opts.storage);
+    HalfGrid* const halves[2] = {&half1, &half2};
+    #pragma omp parallel
+    {
+        int rb, re;
+        thread_rows(0, row, rb, re);
+        narrow_plate_rows(*grids[0], half1, rb, re);
+        narrow_plate_rows(*grids[0], half2, rb, re);
+    }
+    LowPrecisionSchedule schedule(opts, opts.storage);
+    long sweep = 0;
+    while (true) {
+        bool check = schedule.due(++sweep);
+        float residual = parallel_half_sweep(fixed_cells, *halves[(sweep - 1) % 2], *halves[sweep % 2], check);
+        if (check && schedule.done(residual))
+            break;
+    }
+    #pragma omp parallel
+    {
+        int rb, re;
+        thread_rows(1, row - 1, rb, re);
+        widen_plate_rows(fixed_cells, *halves[sweep % 2], *grids[sweep % 2], rb, re);
+    }
+    return sweep;
+}
+
+// Checkpoint of grid after sweep, called by every thread of a parallel
+// region: each thread copies its share of the rows to the staging buffer and
+// one thread starts the write.
+void parallel_checkpoint(CheckpointWriter &checkpoint, long sweep, const ConvergenceSchedule &schedule,
+                         const PlateGrid &grid) {
+    #pragma omp single
+    checkpoint.begin(sweep, schedule);
+    int rb, re;
+    thread_rows(0, grid.rows(), rb, re);
+    checkpoint.stage_rows(grid, rb, re);
+    #pragma omp barrier
+    #pragma omp single nowait
+    checkpoint.commit();
+}
+
+// Frame of grid after sweep, called by every thread of a parallel region:
+// each thread sums its share of the frame rows.
+void parallel_snapshot(SnapshotWriter &snapshot, long sweep, const PlateGrid &grid) {
+    #pragma omp single
+    snapshot.begin(sweep);
+    int rb, re;
+    thread_rows(0, snapshot.rows(), rb, re);
+    snapshot.stage_rows(grid, rb, re);
+    #pragma omp barrier
+    #pragma omp single nowait
+    snapshot.commit();
+}
+
+// Jacobi solve in a single parallel region: each thread keeps its block of
+// rows for every sweep and the threads only meet at one barrier per sweep, so
+// a sweep costs no fork/join. On a checked sweep each thread stores its
+// residual and one thread combines them and updates the schedule. Sweep s
+// writes grids[s % 2]. Runs from sweep first + 1 and returns the sweep that
+// converged.
+long persistent_jacobi(PlateGrid* const grids[2], const FixedCells &fixed_cells, ConvergenceSchedule &schedule,
+                       long first, CheckpointWriter &checkpoint, SnapshotWriter &snapshot) {
+    vector<float> residuals(omp_get_max_threads());
+    bool done = false;
+    long last = 0;
+    #pragma omp parallel
+    {
+        int rb, re, tid = omp_get_thread_num();
+        thread_rows(1, grids[0]->rows() - 1, rb, re);
+        for (long sweep = first + 1; !done; sweep++) {
+            bool check = schedule.due(sweep);
+            // Read before the barriers, ahead of begin() in another thread.
+            bool save = checkpoint.due(sweep), snap = snapshot.due(sweep);
+            PlateGrid &dst = *grids[sweep % 2];
+            float residual = sweep_rows(fixed_cells, *grids[(sweep - 1) % 2], dst, rb, re, check);
+            #pragma omp barrier
+            if (check) {
+                residuals[tid] = max(residual, edge_max_residual(fixed_cells, dst, rb, re));
+                #pragma omp barrier
+                #pragma omp single
+                {
+                    done = schedule.converged(sweep, *max_element(residuals.begin(),
+                                                                  residuals.begin() + omp_get_num_threads()));
+                    last = sweep;
+                }
+            }
+            if (snap)
+                parallel_snapshot(snapshot, sweep, dst);
+            if (save && !done)
+                parallel_checkpoint(checkpoint, sweep, schedule, dst);
+        }
+    }
+    return last;
+}
+
+// Red-black counterpart of persistent_jacobi() on grid in place: one barrier
+// after each color.
+long persistent_redblack(PlateGrid &grid, const FixedCells &fixed_cells, float omega, ConvergenceSchedule &schedule,
+                         long first, CheckpointWriter &checkpoint, SnapshotWriter &snapshot) {
+    vector<float> residuals(omp_get_max_threads());
+    bool done = false;
+    long last = 0;
+    #pragma omp parallel
+    {
+        int rb, re, tid = omp_get_thread_num();
+        thread_rows(1, grid.rows() - 1, rb, re);
+        for (long sweep = first + 1; !done; sweep++) {
+            bool check = schedule.due(sweep);
+            // Read before the barriers, ahead of begin() in another thread.
+            bool save = checkpoint.due(sweep), snap = snapshot.due(sweep);
+            redblack_rows(fixed_cells, grid, rb, re, 0, 0, omega);
+            #pragma omp barrier
+            float residual = redblack_rows(fixed_cells, grid, rb, re, 0, 1, omega, check);
+            #pragma omp barrier
+            if (check) {
+                residuals[tid] = max(residual, edge_max_residual(fixed_cells, grid, rb, re));
+                #pragma omp barrier
+                #pragma omp single
+                {
+                    done = schedule.converged(sweep, *max_element(residuals.begin(),
+                                                                  residuals.begin() + omp_get_num_threads()));
+                    last = sweep;
+                }
+            }
+            if (snap)
+                parallel_snapshot(snapshot, sweep, grid);
+            if (save && !done)
+                parallel_checkpoint(checkpoint, sweep, schedule, grid);
+        }
+    }
+    return last;
+}
+
+// Runs sweeps first+1 .. first+n in temporal blocks of up to `steps` sweeps;
+// sweep s writes grids[s % 2]. The tiles of each phase are shared out among
+// the threads. Returns the number of the last sweep.
+long advance_blocked(PlateGrid* const grids[2], const FixedCells &fixed_cells, long first, long n, int steps) {
+    while (n > 0) {
+        TimeBlockPlan plan = plan_time_block(*grids[0], 1, grids[0]->rows() - 1, (int) min<long>(n, steps));
+        #pragma omp parallel
+        {
+            #pragma omp for schedule(static)
+            for (int k = 0; k < plan.ntiles; k++)
+                time_block_tile(fixed_cells, grids, first, plan, k);
+            #pragma omp for schedule(static)
+            for (int k = 1; k < plan.ntiles; k++)
+                time_block_seam(fixed_cells, grids, first, plan, k);
+        }
+        first += plan.steps;
+        n -= plan.steps;
+    }
+    return first;
+}
+
+int main(int argc, char* argv[]){
+    HotplateOptions opts;
+    // Parallel regions of the Jacobi and red-black solves: one for the whole
+    // solve (default) or one per sweep.
+    const char *region = take_option(argc, argv, "--region");
+    bool persistent = !region || strcmp(region, "sweep") != 0;
+    if (!parse_hotplate_options(argc, argv, opts))
+        return 1;
+    if (argc < 3 || (region && strcmp(region, "solve") != 0 && strcmp(region, "sweep") != 0)) {
+        cerr << "Usage: " << argv[0] << " <rows> <cols>" << HOTPLATE_OPTIONS_USAGE << " [--region solve|sweep]" << endl;
+        return 1;
+    }
+
+    int row = atoi(argv[1]);
+    int col = atoi(argv[2]);
+    int iter = 0;
+    long sweep = 0;
+    bool check;
+    ConvergenceSchedule schedule(opts);
+
+    // Create two matrices with the given number of rows and columns.
+    PlateGrid matrix1(row, col);
+    PlateGrid matrix2(row, col);
+    FixedCells fixed_cells = plate_fixed_cells(opts.scenario, row, col, 0, 1, row - 1);
+
+    // Initialize both matrices.
+    initialize_plate(matrix1, opts.scenario, row, 0, 0, row);
+    initialize_plate(matrix2, opts.scenario, row, 0, 0, row);
+
+    // --restart continues from the sweep of the checkpoint, with both grids
+    // holding its plate.
+    PlateGrid* const grids[2] = {&matrix1, &matrix2};
+    if (opts.restart && (sweep = load_checkpoint(opts.checkpoint_path, row, col, opts.solver, grids, 2, schedule)) < 0)
+        return 1;
+    CheckpointWriter checkpoint(opts, row, col, sweep);
+    SnapshotWriter snapshot(opts, row, col, sweep);
+
+    auto t_start = chrono::high_resolution_clock::now();
+
+    if (opts.solver == SOLVER_MULTIGRID) {
+        // Multigrid cycles work on matrix1 in place; every thread runs the
+        // cycle and shares out each of its loops. Each cycle counts.
+        Multigrid mg(fixed_cells, row, col, opts.cycle_gamma);
+        while (true) {
+            #pragma omp parallel
+            mg.cycle(matrix1);
+
+            check = schedule.due(++sweep);
+            if (snapshot.due(sweep)) {
+                #pragma omp parallel
+                parallel_snapshot(snapshot, sweep, matrix1);
+            }
+            if (check) {
+                float residual = 0.0f;
+                #pragma omp parallel for reduction(max:residual) schedule(static)
+                for (int i = 1; i < row - 1; i++)
+                    residual = max(residual, max_residual_rows(fixed_cells, matrix1, i, i + 1));
+                if (schedule.converged(sweep, residual))
+                    break;
+            }
+            if (checkpoint.due(sweep)) {
+                #pragma omp parallel
+                parallel_checkpoint(checkpoint, sweep, schedule, matrix1);
+            }
+        }
+        iter = (int) sweep;
+    } else if (opts.red_black()) {
+        // Red-black sweeps work on matrix1 in place; each one counts.
+        float omega = opts.relaxation(row, col);
+        if (persistent) {
+            sweep = persistent_redblack(matrix1, fixed_cells, omega, schedule, sweep, checkpoint, snapshot);
+        } else {
+            while (true) {
+                check = schedule.due(++sweep);
+                float residual = parallel_redblack(fixed_cells, matrix1, omega, check);
+                if (snapshot.due(sweep)) {
+                    #pragma omp parallel
+                    parallel_snapshot(snapshot, sweep, matrix1);
+                }
+                if (check && schedule.converged(sweep, residual))
+                    break;
+                if (checkpoint.due(sweep)) {
+                    #pragma omp parallel
+                    parallel_checkpoint(checkpoint, sweep, schedule, matrix1);
+                }
+            }
+        }
+        iter = (int) sweep;
+    } else {
+        // Sweep s writes grids[s % 2]: the first sweep of each cycle updates
+        // matrix2 from matrix1, the second matrix1 from matrix2.
+        // Temporal blocking opens its own regions for each block, and so do
+        // the 16-bit sweeps that come first with --storage fp16|bf16.
+        if (opts.storage != STORAGE_FP32)
+            sweep = low_precision_sweeps(grids, fixed_cells, opts);
+        if (persistent && opts.time_block <= 1) {
+            sweep = persistent_jacobi(grids, fixed_cells, schedule, sweep, checkpoint, snapshot);
+        } else {
+            while (true) {
+                // With temporal blocking, the sweeps up to the next check run in blocks.
+                if (opts.time_block > 1)
+                    sweep = advance_blocked(grids, fixed_cells, sweep, schedule.next_due() - 1 - sweep, opts.time_block);
+
+                check = schedule.due(++sweep);
+                float residual = parallel_sweep(fixed_cells, *grids[(sweep - 1) % 2], *grids[sweep % 2], check);
+                if (snapshot.due(sweep)) {
+                    #pragma omp parallel
+                    parallel_snapshot(snapshot, sweep, *grids[sweep % 2]);
+                }
+                if (check && schedule.converged(sweep, residual))
+                    break;
+                if (checkpoint.due(sweep)) {
+                    #pragma omp parallel
+                    parallel_checkpoint(checkpoint, sweep, schedule, *grids[sweep % 2]);
+                }
+            }
+        }
+        // Full cycles (both sweeps) completed before the converged sweep.
+        iter = (int) ((sweep - 1) / 2);
+    }
+
+    auto t_end = chrono::high_resolution_clock::now();
+    double exec_time = chrono::duration<double>(t_end - t_start).count();
+
+    // Count hot cells (using parallel reduction)
+    int hot_cells = 0;
+    #pragma omp parallel for reduction(+:hot_cells) schedule(static)
+    for (int i = 0; i < row; i++)
+        hot_cells += count_hot_cells(matrix1, i, i + 1);
+
+    cout << "N° Iteraciones: " << iter << endl;
+    cout << "Tiempo de ejecucion: " << exec_time << " segundos" << endl;
+    cout << "Num. de celdas calientes: " << hot_cells << endl;
+
+    return 0;
+}
@@ -0,0 +1,275 @@
+#ifndef HOTPLATE_OPTIONS_H
+#define HOTPLATE_OPTIONS_H
+
+// Command-line options shared by the ExerciseII solvers, and the schedule of
+// convergence checks they control.
+//
+// Options may appear anywhere after the program name; parse_hotplate_options()
+// takes them out of argv so the positional arguments keep their places.
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "hotplate_grid.h"
+
+const char* const HOTPLATE_OPTIONS_USAGE =
+    " [--solver jacobi|rbgs|sor|multigrid] [--omega W] [--cycle v|w] [--check-every N] [--predict] [--time-block T]"
+    " [--scenario FILE] [--checkpoint-every N] [--checkpoint FILE] [--restart]"
+    " [--snapshot-every N] [--snapshot FILE] [--snapshot-stride S] [--storage fp32|fp16|bf16]";
+
+// Removes "<name> <value>" from argv, wherever it appears, and returns the
+// value, or nullptr when the option is absent.
+inline const char* take_option(int &argc, char* argv[], const char *name) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], name) == 0) {
+            const char *value = argv[i + 1];
+            for (int k = i; k + 2 <= argc; k++)
+                argv[k] = argv[k + 2];
+            argc -= 2;
+            return value;
+        }
+    }
+    return nullptr;
+}
+
+// Removes the flag <name> from argv and returns whether it was there.
+inline bool take_flag(int &argc, char* argv[], const char *name) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], name) == 0) {
+            for (int k = i; k + 1 <= argc; k++)
+                argv[k] = argv[k + 1];
+            argc--;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Update scheme. Jacobi writes each sweep into the other buffer; red-black
+// Gauss-Seidel updates one buffer in place, first the cells with an even
+// (row + column), then the odd ones, and SOR over-relaxes that update by
+// omega. A red-black sweep is both colors. Multigrid runs V- or W-cycles
+// (hotplate_multigrid.h) in place.
+enum HotplateSolver { SOLVER_JACOBI, SOLVER_RBGS, SOLVER_SOR, SOLVER_MULTIGRID };
+
+// Cells of the plate in memory. The 16-bit formats run the Jacobi sweeps on
+// IEEE half or bfloat16 cells until they can resolve no more, then finish in
+// fp32 (hotplate_precision.h).
+enum StorageFormat { STORAGE_FP32, STORAGE_FP16, STORAGE_BF16 };
+
+struct HotplateOptions {
+    HotplateSolver solver;
+    float omega;     // SOR relaxation factor; 0 picks sor_default_omega()
+    int cycle_gamma; // multigrid coarse visits per level: 1 for V-cycles, 2 for W-cycles
+    int check_every; // sweeps between convergence checks (the longest gap with predict)
+    bool predict;    // place checks where the residual trend predicts convergence
+    int time_block;  // sweeps per temporal block; 1 runs plain sweeps
+    Scenario scenario; // plate geometry and tolerance (--scenario FILE)
+    int checkpoint_every;        // sweeps between checkpoints; 0 takes none
+    const char *checkpoint_path; // checkpoint file (hotplate_checkpoint.h)
+    bool restart;                // start from the checkpoint at checkpoint_path
+    int snapshot_every;          // sweeps between snapshots; 0 takes none
+    const char *snapshot_path;   // snapshot stream (hotplate_snapshot.h)
+    int snapshot_stride;         // snapshot cells are averages of stride x stride plate cells
+    StorageFormat storage;       // cells of the first sweeps
+    HotplateOptions()
+        : solver(SOLVER_JACOBI), omega(0.0f), cycle_gamma(1), check_every(1), predict(false), time_block(1),
+          checkpoint_every(0), checkpoint_path("hotplate.ckpt"), restart(false),
+          snapshot_every(0), snapshot_path("hotplate.snap"), snapshot_stride(1),
+          storage(STORAGE_FP32) {}
+
+    bool red_black() const { return solver == SOLVER_RBGS || solver == SOLVER_SOR; }
+    // Relaxation factor for a rows x cols plate: 1 for Gauss-Seidel.
+    float relaxation(int rows, int cols) const {
+        if (solver != SOLVER_SOR)
+            return 1.0f;
+        return omega > 0.0f ? omega : sor_default_omega(rows, cols);
+    }
+};
+
+// Reads and removes the solver options from argv. Prints an error and
+// returns false on an invalid value.
+inline bool parse_hotplate_options(int &argc, char* argv[], HotplateOptions &opt) {
+    if (const char *v = take_option(argc, argv, "--solver")) {
+        if (strcmp(v, "jacobi") == 0)
+            opt.solver = SOLVER_JACOBI;
+        else if (strcmp(v, "rbgs") == 0)
+            opt.solver = SOLVER_RBGS;
+        else if (strcmp(v, "sor") == 0)
+            opt.solver = SOLVER_SOR;
+        else if (strcmp(v, "multigrid") == 0)
+            opt.solver = SOLVER_MULTIGRID;
+        else {
+            std::cerr << "Error: unknown solver '" << v << "' (jacobi, rbgs, sor or multigrid)" << std::endl;
+            return false;
+        }
+    }
+    if (const char *v = take_option(argc, argv, "--omega")) {
+        opt.omega = (float) atof(v);
+        if (opt.solver != SOLVER_SOR) {
+            std::cerr << "Error: --omega needs --solver sor" << std::endl;
+            return false;
+        }
+        if (!(opt.omega > 0.0f && opt.omega < 2.0f)) {
+            std::cerr << "Error: --omega must be between 0 and 2" << std::endl;
+            return false;
+        }
+    }
+    if (const char *v = take_option(argc, argv, "--time-block")) {
+        opt.time_block = atoi(v);
+        if (opt.time_block < 1) {
+            std::cerr << "Error: --time-block must be at least 1" << std::endl;
+            return false;
+        }
+        // Blocks only run between checks, so by default check once per block.
+        opt.check_every = opt.time_block;
+    }
+    if (const char *v = take_option(argc, argv, "--check-every")) {
+        opt.check_every = atoi(v);
+        if (opt.check_every < 1) {
+            std::cerr << "Error: --check-every must be at least 1" << std::endl;
+            return false;
+        }
+        // A shorter gap would cut every block short, down to plain sweeps.
+        if (opt.check_every < opt.time_block) {
+            std::cerr << "Error: --check-every must be at least --time-block" << std::endl;
+            return false;
+        }
+    }
+    if (const char *v = take_option(argc, argv, "--cycle")) {
+        if (opt.solver != SOLVER_MULTIGRID) {
+            std::cerr << "Error: --cycle needs --solver multigrid" << std::endl;
+            return false;
+        }
+        if (strcmp(v, "v") == 0 || strcmp(v, "V") == 0)
+            opt.cycle_gamma = 1;
+        else if (strcmp(v, "w") == 0 || strcmp(v, "W") == 0)
+            opt.cycle_gamma = 2;
+        else {
+            std::cerr << "Error: --cycle must be v or w" << std::endl;
+            return false;
+        }
+    }
+    if (const char *v = take_option(argc, argv, "--scenario")) {
+        if (!load_scenario(v, opt.scenario))
+            return false;
+    }
+    if (const char *v = take_option(argc, argv, "--checkpoint-every")) {
+        opt.checkpoint_every = atoi(v);
+        if (opt.checkpoint_every < 1) {
+            std::cerr << "Error: --checkpoint-every must be at least 1" << std::endl;
+            return false;
+        }
+    }
+    if (const char *v = take_option(argc, argv, "--checkpoint"))
+        opt.checkpoint_path = v;
+    opt.restart = take_flag(argc, argv, "--restart");
+    if (const char *v = take_option(argc, argv, "--snapshot-every")) {
+        opt.snapshot_every = atoi(v);
+        if (opt.snapshot_every < 1) {
+            std::cerr << "Error: --snapshot-every must be at least 1" << std::endl;
+            return false;
+        }
+    }
+    if (const char *v = take_option(argc, argv, "--snapshot"))
+        opt.snapshot_path = v;
+    if (const char *v = take_option(argc, argv, "--snapshot-stride")) {
+        opt.snapshot_stride = atoi(v);
+        if (opt.snapshot_stride < 1) {
+            std::cerr << "Error: --snapshot-stride must be at least 1" << std::endl;
+            return false;
+        }
+    }
+    if (const char *v = take_option(argc, argv, "--storage")) {
+        if (strcmp(v, "fp32") == 0)
+            opt.storage = STORAGE_FP32;
+        else if (strcmp(v, "fp16") == 0)
+            opt.storage = STORAGE_FP16;
+        else if (strcmp(v, "bf16") == 0)
+            opt.storage = STORAGE_BF16;
+        else {
+            std::cerr << "Error: unknown storage '" << v << "' (fp32, fp16 or bf16)" << std::endl;
+            return false;
+        }
+    }
+    opt.predict = take_flag(argc, argv, "--predict");
+    if (opt.time_block > 1 && opt.solver != SOLVER_JACOBI) {
+        std::cerr << "Error: --time-block only applies to the jacobi solver" << std::endl;
+        return false;
+    }
+    if (opt.storage != STORAGE_FP32) {
+        if (opt.solver != SOLVER_JACOBI || opt.time_block > 1) {
+            std::cerr << "Error: --storage fp16|bf16 needs the jacobi solver without --time-block" << std::endl;
+            return false;
+        }
+        if (opt.restart || opt.checkpoint_every > 0 || opt.snapshot_every > 0) {
+            std::cerr << "Error: --storage fp16|bf16 does not combine with checkpoints or snapshots" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Decides which sweeps run the convergence check. Sweeps are numbered from 1;
+// for multigrid a "sweep" is one cycle.
+//
+// Without prediction every check_every-th sweep is checked, so the solver
+// stops at most check_every-1 sweeps after the plate converged (with 1, the
+// default, exactly where it converged). With prediction the decay rate of the
+// max residual between the last two checks gives the number of sweeps left
+// until it drops to the tolerance, and the next check is placed there, never
+// further than check_every away. Sweeps without a check need no residual and
+// no global reduction.
+//
+// Every thread or rank that calls converged() with the same residuals makes
+// the same decisions.
+class ConvergenceSchedule {
+public:
+    explicit ConvergenceSchedule(const HotplateOptions &opt = HotplateOptions())
+        : max_interval(opt.check_every), predict(opt.predict), tolerance(opt.scenario.tolerance),
+          next_check(opt.check_every), last_sweep(0), last_residual(0.0f) {}
+
+    bool due(long sweep) const { return sweep >= next_check; }
+    // The next sweep that checks.
+    long next_due() const { return next_check; }
+    // The last check that did not converge, and its residual (0 before any).
+    long last_checked() const { return last_sweep; }
+    float last_checked_residual() const { return last_residual; }
+
+    // Continues from the state of another schedule, saved in a checkpoint.
+    void resume(long next, long last, float residual) {
+        next_check = next;
+        last_sweep = last;
+        last_residual = residual;
+    }
+
+    // Records the max residual found by a due sweep. Returns true when the
+    // plate has converged; otherwise schedules the next check.
+    bool converged(long sweep, float residual) {
+        if (residual <= tolerance)
+            return true;
+        long interval = max_interval;
+        if (predict && last_sweep > 0 && residual < last_residual) {
+            double rate = log((double) residual / last_residual) / (sweep - last_sweep);
+            double left = log((double) tolerance / residual) / rate;
+            if (left < interval)
+                interval = left < 1.0 ? 1 : (long) ceil(left);
+        }
+        last_sweep = sweep;
+        last_residual = residual;
+        next_check = sweep + interval;
+        return false;
+    }
+
+private:
+    long max_interval;
+    bool predict;
+    float tolerance;
+    long next_check;
+    long last_sweep;
+    float last_residual;
+};
+
+#endif
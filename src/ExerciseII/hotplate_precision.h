@@ -0,0 +1,479 @@
+#ifndef HOTPLATE_PRECISION_H
+#define HOTPLATE_PRECISION_H
+
+// Mixed-precision Jacobi sweeps for the hotplate: 16-bit storage, fp32
+// arithmetic.
+//
+// With --storage fp16 or bf16 the plate is first swept in two HalfGrid
+// buffers of IEEE half or bfloat16 cells, half the bytes of a PlateGrid, so
+// each of these memory-bound sweeps moves half the data. The row kernels load
+// the 16-bit cells into fp32 registers (F16C / AVX-512F conversions, or the
+// integer shifts that make bfloat16 a truncated float), evaluate the same
+// expressions as the fp32 kernels and round the result back to 16 bits to
+// nearest even.
+//
+// A 16-bit plate cannot reach the convergence tolerance by itself: near 100
+// degrees fp16 resolves steps of 1/16 and bf16 of 1/2, and once the updates
+// fall below half a step they round away and the residual stops falling.
+// The low-precision sweeps therefore stop when the residual reaches what the
+// format can resolve or stops improving (LowPrecisionSchedule), and the plate
+// is widened into the fp32 grids, which sweep on to the tolerance as usual.
+// The border and the fixed cells are taken from the fp32 grids, so the
+// refinement solves exactly the fp32 problem.
+//
+// All kernels of a format produce the same bits: the vector conversions round
+// to nearest even like the scalar ones, and the sums are formed in the order
+// of the fp32 kernels (hotplate_grid.h).
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+#include <immintrin.h>
+
+#include "hotplate_grid.h"
+#include "hotplate_options.h"
+
+const int PLATE_ROW_HALVES = PLATE_ALIGNMENT / sizeof(uint16_t);
+
+// ---- Formats ----
+// to_float() and from_float() convert one cell; the vector forms convert 8
+// (AVX2) or 16 (AVX-512F) cells at unaligned addresses. The AVX-512 forms use
+// the all-lanes maskz intrinsics, as in hotplate_grid.h, because the unmasked
+// ones start from an "undefined" vector GCC 12 warns about.
+
+const __mmask16 ALL_LANES16 = 0xFFFF;
+
+struct Fp16Format {
+    static float to_float(uint16_t h) {
+        uint32_t sign = (uint32_t) (h & 0x8000) << 16, exp = (h >> 10) & 0x1F, mant = h & 0x3FF;
+        if (exp == 0) // zero or subnormal: mant * 2^-24, exact
+            return sign ? -ldexpf((float) mant, -24) : ldexpf((float) mant, -24);
+        uint32_t bits = sign | (exp == 31 ? 0x7F800000 | mant << 13 : (exp + 112) << 23 | mant << 13);
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+
+    static uint16_t from_float(float f) {
+        uint32_t x;
+        memcpy(&x, &f, sizeof(x));
+        uint16_t sign = (x >> 16) & 0x8000;
+        x &= 0x7FFFFFFF;
+        if (x > 0x7F800000) // NaN, quieted as vcvtps2ph does
+            return sign | 0x7E00 | ((x >> 13) & 0x3FF);
+        if (x >= 0x477FF000) // rounds to 65520 or more: infinity
+            return sign | 0x7C00;
+        if (x >= 0x38800000) { // normal half: rebias, round off 13 bits
+            uint32_t h = (x - 0x38000000) >> 13, rem = x & 0x1FFF;
+            if (rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+                h++;
+            return sign | h;
+        }
+        // Subnormal half: the value in units of 2^-24, rounded.
+        int shift = 126 - (int) (x >> 23);
+        if (shift > 24)
+            return sign;
+        uint32_t m = (x & 0x7FFFFF) | 0x800000;
+        uint32_t h = m >> shift, rem = m & ((1u << shift) - 1), half = 1u << (shift - 1);
+        if (rem > half || (rem == half && (h & 1)))
+            h++;
+        return sign | h;
+    }
+
+    __attribute__((target("avx2,f16c")))
+    static __m256 load8(const uint16_t *p) {
+        return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*) p));
+    }
+
+    __attribute__((target("avx2,f16c")))
+    static void store8(uint16_t *p, __m256 v) {
+        _mm_storeu_si128((__m128i*) p, _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    }
+
+    __attribute__((target("avx512f")))
+    static __m512 load16(const uint16_t *p) {
+        return _mm512_maskz_cvtph_ps(ALL_LANES16, _mm256_loadu_si256((const __m256i*) p));
+    }
+
+    __attribute__((target("avx512f")))
+    static void store16(uint16_t *p, __m512 v) {
+        __m256i h = _mm512_maskz_cvtps_ph(ALL_LANES16, v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        _mm256_storeu_si256((__m256i*) p, h);
+    }
+};
+
+// bfloat16 is the top half of a float. Rounding adds 0x7FFF plus the lowest
+// kept bit before truncating; the plate holds no NaNs, so they are not
+// special-cased.
+struct Bf16Format {
+    static float to_float(uint16_t h) {
+        uint32_t bits = (uint32_t) h << 16;
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+
+    static uint16_t from_float(float f) {
+        uint32_t x;
+        memcpy(&x, &f, sizeof(x));
+        return (uint16_t) ((x + 0x7FFF + ((x >> 16) & 1)) >> 16);
+    }
+
+    __attribute__((target("avx2,f16c")))
+    static __m256 load8(const uint16_t *p) {
+        __m256i w = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*) p));
+        return _mm256_castsi256_ps(_mm256_slli_epi32(w, 16));
+    }
+
+    __attribute__((target("avx2,f16c")))
+    static void store8(uint16_t *p, __m256 v) {
+        __m256i x = _mm256_castps_si256(v);
+        __m256i lsb = _mm256_and_si256(_mm256_srli_epi32(x, 16), _mm256_set1_epi32(1));
+        x = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(x, _mm256_set1_epi32(0x7FFF)), lsb), 16);
+        // packus works within 128-bit lanes, so the two halves are packed by hand.
+        _mm_storeu_si128((__m128i*) p, _mm_packus_epi32(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1)));
+    }
+
+    __attribute__((target("avx512f")))
+    static __m512 load16(const uint16_t *p) {
+        __m512i w = _mm512_maskz_cvtepu16_epi32(ALL_LANES16, _mm256_loadu_si256((const __m256i*) p));
+        return _mm512_castsi512_ps(_mm512_maskz_slli_epi32(ALL_LANES16, w, 16));
+    }
+
+    __attribute__((target("avx512f")))
+    static void store16(uint16_t *p, __m512 v) {
+        __m512i x = _mm512_castps_si512(v);
+        __m512i lsb = _mm512_and_si512(_mm512_maskz_srli_epi32(ALL_LANES16, x, 16), _mm512_set1_epi32(1));
+        x = _mm512_add_epi32(_mm512_add_epi32(x, _mm512_set1_epi32(0x7FFF)), lsb);
+        x = _mm512_maskz_srli_epi32(ALL_LANES16, x, 16);
+        _mm256_storeu_si256((__m256i*) p, _mm512_maskz_cvtepi32_epi16(ALL_LANES16, x));
+    }
+};
+
+// ---- Row kernels ----
+// The 16-bit counterparts of stencil_row and max_residual_row, with the same
+// 1-based convention, plus whole-row conversions of n cells. The AVX-512
+// kernels finish rows with scalar code, since masked 16-bit loads and stores
+// would need AVX-512BW.
+
+template <class F>
+inline void half_stencil_row_scalar(uint16_t *dst, const uint16_t *up, const uint16_t *mid, const uint16_t *down,
+                                    int len) {
+    for (int j = 1; j <= len; j++)
+        dst[j] = F::from_float((F::to_float(down[j]) + F::to_float(up[j]) + F::to_float(mid[j+1]) +
+                                F::to_float(mid[j-1]) + 4 * F::to_float(mid[j])) / 8.0f);
+}
+
+template <class F>
+inline float half_max_residual_row_scalar(const uint16_t *up, const uint16_t *mid, const uint16_t *down, int len) {
+    float res = 0.0f;
+    for (int j = 1; j <= len; j++)
+        res = std::max(res, fabsf(F::to_float(mid[j]) - (F::to_float(down[j]) + F::to_float(up[j]) +
+                                                         F::to_float(mid[j+1]) + F::to_float(mid[j-1])) / 4.0f));
+    return res;
+}
+
+template <class F>
+inline void half_to_float_row_scalar(float *dst, const uint16_t *src, int n) {
+    for (int j = 0; j < n; j++)
+        dst[j] = F::to_float(src[j]);
+}
+
+template <class F>
+inline void half_from_float_row_scalar(uint16_t *dst, const float *src, int n) {
+    for (int j = 0; j < n; j++)
+        dst[j] = F::from_float(src[j]);
+}
+
+template <class F>
+__attribute__((target("avx2,f16c")))
+inline void half_stencil_row_avx2(uint16_t *dst, const uint16_t *up, const uint16_t *mid, const uint16_t *down,
+                                  int len) {
+    const __m256 four = _mm256_set1_ps(4.0f), eighth = _mm256_set1_ps(0.125f);
+    int j = 1;
+    for (; j + 8 <= len + 1; j += 8) {
+        __m256 s = _mm256_add_ps(F::load8(down + j), F::load8(up + j));
+        s = _mm256_add_ps(s, F::load8(mid + j + 1));
+        s = _mm256_add_ps(s, F::load8(mid + j - 1));
+        s = _mm256_add_ps(s, _mm256_mul_ps(four, F::load8(mid + j)));
+        F::store8(dst + j, _mm256_mul_ps(s, eighth));
+    }
+    half_stencil_row_scalar<F>(dst + j - 1, up + j - 1, mid + j - 1, down + j - 1, len + 1 - j);
+}
+
+template <class F>
+__attribute__((target("avx2,f16c")))
+inline float half_max_residual_row_avx2(const uint16_t *up, const uint16_t *mid, const uint16_t *down, int len) {
+    const __m256 quarter = _mm256_set1_ps(0.25f);
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    __m256 vres = _mm256_setzero_ps();
+    int j = 1;
+    for (; j + 8 <= len + 1; j += 8) {
+        __m256 s = _mm256_add_ps(F::load8(down + j), F::load8(up + j));
+        s = _mm256_add_ps(s, F::load8(mid + j + 1));
+        s = _mm256_add_ps(s, F::load8(mid + j - 1));
+        __m256 r = _mm256_and_ps(_mm256_sub_ps(F::load8(mid + j), _mm256_mul_ps(s, quarter)), abs_mask);
+        vres = _mm256_max_ps(vres, r);
+    }
+    alignas(32) float lanes[8];
+    _mm256_store_ps(lanes, vres);
+    float res = half_max_residual_row_scalar<F>(up + j - 1, mid + j - 1, down + j - 1, len + 1 - j);
+    for (int k = 0; k < 8; k++)
+        res = std::max(res, lanes[k]);
+    return res;
+}
+
+template <class F>
+__attribute__((target("avx2,f16c")))
+inline void half_to_float_row_avx2(float *dst, const uint16_t *src, int n) {
+    int j = 0;
+    for (; j + 8 <= n; j += 8)
+        _mm256_storeu_ps(dst + j, F::load8(src + j));
+    half_to_float_row_scalar<F>(dst + j, src + j, n - j);
+}
+
+template <class F>
+__attribute__((target("avx2,f16c")))
+inline void half_from_float_row_avx2(uint16_t *dst, const float *src, int n) {
+    int j = 0;
+    for (; j + 8 <= n; j += 8)
+        F::store8(dst + j, _mm256_loadu_ps(src + j));
+    half_from_float_row_scalar<F>(dst + j, src + j, n - j);
+}
+
+template <class F>
+__attribute__((target("avx512f")))
+inline void half_stencil_row_avx512(uint16_t *dst, const uint16_t *up, const uint16_t *mid, const uint16_t *down,
+                                    int len) {
+    const __m512 four = _mm512_set1_ps(4.0f), eighth = _mm512_set1_ps(0.125f);
+    int j = 1;
+    for (; j + 16 <= len + 1; j += 16) {
+        __m512 s = _mm512_add_ps(F::load16(down + j), F::load16(up + j));
+        s = _mm512_add_ps(s, F::load16(mid + j + 1));
+        s = _mm512_add_ps(s, F::load16(mid + j - 1));
+        s = _mm512_add_ps(s, _mm512_mul_ps(four, F::load16(mid + j)));
+        F::store16(dst + j, _mm512_mul_ps(s, eighth));
+    }
+    half_stencil_row_scalar<F>(dst + j - 1, up + j - 1, mid + j - 1, down + j - 1, len + 1 - j);
+}
+
+template <class F>
+__attribute__((target("avx512f")))
+inline float half_max_residual_row_avx512(const uint16_t *up, const uint16_t *mid, const uint16_t *down, int len) {
+    const __m512 quarter = _mm512_set1_ps(0.25f);
+    __m512 vres = _mm512_setzero_ps();
+    int j = 1;
+    for (; j + 16 <= len + 1; j += 16) {
+        __m512 s = _mm512_add_ps(F::load16(down + j), F::load16(up + j));
+        s = _mm512_add_ps(s, F::load16(mid + j + 1));
+        s = _mm512_add_ps(s, F::load16(mid + j - 1));
+        __m512 r = _mm512_abs_ps(_mm512_sub_ps(F::load16(mid + j), _mm512_mul_ps(s, quarter)));
+        vres = _mm512_maskz_max_ps(ALL_LANES16, vres, r);
+    }
+    alignas(64) float lanes[16];
+    _mm512_store_ps(lanes, vres);
+    float res = half_max_residual_row_scalar<F>(up + j - 1, mid + j - 1, down + j - 1, len + 1 - j);
+    for (int k = 0; k < 16; k++)
+        res = std::max(res, lanes[k]);
+    return res;
+}
+
+template <class F>
+__attribute__((target("avx512f")))
+inline void half_to_float_row_avx512(float *dst, const uint16_t *src, int n) {
+    int j = 0;
+    for (; j + 16 <= n; j += 16)
+        _mm512_storeu_ps(dst + j, F::load16(src + j));
+    half_to_float_row_scalar<F>(dst + j, src + j, n - j);
+}
+
+template <class F>
+__attribute__((target("avx512f")))
+inline void half_from_float_row_avx512(uint16_t *dst, const float *src, int n) {
+    int j = 0;
+    for (; j + 16 <= n; j += 16)
+        F::store16(dst + j, _mm512_loadu_ps(src + j));
+    half_from_float_row_scalar<F>(dst + j, src + j, n - j);
+}
+
+struct HalfKernels {
+    void (*stencil_row)(uint16_t *dst, const uint16_t *up, const uint16_t *mid, const uint16_t *down, int len);
+    float (*max_residual_row)(const uint16_t *up, const uint16_t *mid, const uint16_t *down, int len);
+    void (*to_float_row)(float *dst, const uint16_t *src, int n);
+    void (*from_float_row)(uint16_t *dst, const float *src, int n);
+    float resolution; // spacing of the format's values in [64, 128)
+};
+
+template <class F>
+inline HalfKernels select_half_kernels(float resolution) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return HalfKernels{half_stencil_row_avx512<F>, half_max_residual_row_avx512<F>,
+                           half_to_float_row_avx512<F>, half_from_float_row_avx512<F>, resolution};
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c"))
+        return HalfKernels{half_stencil_row_avx2<F>, half_max_residual_row_avx2<F>,
+                           half_to_float_row_avx2<F>, half_from_float_row_avx2<F>, resolution};
+    return HalfKernels{half_stencil_row_scalar<F>, half_max_residual_row_scalar<F>,
+                       half_to_float_row_scalar<F>, half_from_float_row_scalar<F>, resolution};
+}
+
+// Kernels of a 16-bit storage format (STORAGE_FP16 or STORAGE_BF16).
+inline const HalfKernels& half_kernels(int format) {
+    static const HalfKernels fp16 = select_half_kernels<Fp16Format>(1.0f / 16);
+    static const HalfKernels bf16 = select_half_kernels<Bf16Format>(0.5f);
+    return format == STORAGE_BF16 ? bf16 : fp16;
+}
+
+// ---- 16-bit grid ----
+
+// A plate of 16-bit cells in one of the storage formats, laid out like a
+// PlateGrid: row-major, rows padded to a multiple of 64 bytes.
+class HalfGrid {
+public:
+    HalfGrid(int rows, int cols, int format)
+        : ptr(nullptr), nrows(rows), ncols(cols), fmt(format),
+          ld((cols + PLATE_ROW_HALVES - 1) / PLATE_ROW_HALVES * PLATE_ROW_HALVES) {
+        size_t bytes = (size_t) nrows * ld * sizeof(uint16_t);
+        if (bytes > 0) {
+            if (!(ptr = (uint16_t*) aligned_alloc(PLATE_ALIGNMENT, bytes)))
+                throw std::bad_alloc();
+            memset(ptr, 0, bytes);
+        }
+    }
+    ~HalfGrid() { free(ptr); }
+    HalfGrid(const HalfGrid&) = delete;
+    HalfGrid& operator=(const HalfGrid&) = delete;
+
+    int rows() const { return nrows; }
+    int cols() const { return ncols; }
+    int format() const { return fmt; }
+    const HalfKernels& kernels() const { return half_kernels(fmt); }
+    size_t stride() const { return ld; }
+
+    uint16_t* row(int i) { return ptr + (size_t) i * ld; }
+    const uint16_t* row(int i) const { return ptr + (size_t) i * ld; }
+
+private:
+    uint16_t *ptr;
+    int nrows, ncols, fmt;
+    size_t ld;
+};
+
+// Rounds rows [row_begin, row_end) of plate, whole, into grid.
+inline void narrow_plate_rows(const PlateGrid &plate, HalfGrid &grid, int row_begin, int row_end) {
+    const HalfKernels &kern = grid.kernels();
+    for (int i = row_begin; i < row_end; i++)
+        kern.from_float_row(grid.row(i), plate.row(i), plate.cols());
+}
+
+// Widens the interior cells of rows [row_begin, row_end) of grid into plate,
+// then puts back the fixed cells of those rows, so only the free cells take
+// the 16-bit values.
+inline void widen_plate_rows(const FixedCells &fixed, const HalfGrid &grid, PlateGrid &plate, int row_begin,
+                             int row_end) {
+    const HalfKernels &kern = grid.kernels();
+    for (int i = row_begin; i < row_end; i++)
+        kern.to_float_row(plate.row(i) + 1, grid.row(i) + 1, plate.cols() - 2);
+    for (size_t k = std::lower_bound(fixed.rows.begin(), fixed.rows.end(), row_begin) - fixed.rows.begin();
+         k < fixed.size() && fixed.rows[k] < row_end; k++)
+        plate(fixed.rows[k], fixed.cols[k]) = fixed.values[k];
+}
+
+// ---- Sweeps ----
+// half_sweep_rows() and half_edge_max_residual() are sweep_rows() and
+// edge_max_residual() on 16-bit grids, whole interior rows only.
+
+// Max residual of grid row i without its fixed cells; see row_max_residual().
+inline float half_row_max_residual(const HalfKernels &kern, const FixedCells &fixed, size_t &k,
+                                   const HalfGrid &grid, int i) {
+    size_t ld = grid.stride();
+    const uint16_t *mid = grid.row(i);
+    int col_end = grid.cols() - 1;
+    while (k < fixed.size() && fixed.rows[k] < i)
+        k++;
+    float res = 0.0f;
+    int j = 1;
+    for (; k < fixed.size() && fixed.rows[k] == i; k++) {
+        int c = fixed.cols[k];
+        res = std::max(res, kern.max_residual_row(mid - ld + j - 1, mid + j - 1, mid + ld + j - 1, c - j));
+        j = c + 1;
+    }
+    return std::max(res, kern.max_residual_row(mid - ld + j - 1, mid + j - 1, mid + ld + j - 1, col_end - j));
+}
+
+inline float half_sweep_rows(const FixedCells &fixed, const HalfGrid &src, HalfGrid &dst, int row_begin,
+                             int row_end, bool check = true) {
+    const HalfKernels &kern = src.kernels();
+    size_t ld = src.stride();
+    int len = src.cols() - 2;
+    size_t kf = std::lower_bound(fixed.rows.begin(), fixed.rows.end(), row_begin) - fixed.rows.begin();
+    size_t kr = kf;
+    float res = 0.0f;
+    for (int i = row_begin; i < row_end; i++) {
+        const uint16_t *mid = src.row(i);
+        uint16_t *out = dst.row(i);
+        kern.stencil_row(out, mid - ld, mid, mid + ld, len);
+        for (; kf < fixed.size() && fixed.rows[kf] == i; kf++)
+            out[fixed.cols[kf]] = mid[fixed.cols[kf]];
+        if (check && i - 1 > row_begin)
+            res = std::max(res, half_row_max_residual(kern, fixed, kr, dst, i - 1));
+    }
+    return res;
+}
+
+inline float half_edge_max_residual(const FixedCells &fixed, const HalfGrid &grid, int row_begin, int row_end) {
+    if (row_end <= row_begin)
+        return 0.0f;
+    const HalfKernels &kern = grid.kernels();
+    size_t k = std::lower_bound(fixed.rows.begin(), fixed.rows.end(), row_begin) - fixed.rows.begin();
+    float res = half_row_max_residual(kern, fixed, k, grid, row_begin);
+    if (row_end - 1 > row_begin)
+        res = std::max(res, half_row_max_residual(kern, fixed, k, grid, row_end - 1));
+    return res;
+}
+
+// ---- Hand-over ----
+
+// The low-precision residual is checked every LOW_PRECISION_CHECK_EVERY
+// sweeps; LOW_PRECISION_PATIENCE checks in a row without a new lowest
+// residual count as a stall. The max residual of a Jacobi plate can sit
+// still for a few checks before falling again, even in fp32.
+const int LOW_PRECISION_CHECK_EVERY = 10;
+const int LOW_PRECISION_PATIENCE = 5;
+
+// Decides when the 16-bit sweeps hand the plate over to fp32.
+class LowPrecisionSchedule {
+public:
+    // Rounding the four neighbours and the cell itself leaves residuals of
+    // about one step of the format, so below two steps the residual is
+    // mostly rounding.
+    LowPrecisionSchedule(const HotplateOptions &opt, int format)
+        : floor(std::max(opt.scenario.tolerance, 2 * half_kernels(format).resolution)),
+          lowest(INFINITY), stalled(0) {}
+
+    bool due(long sweep) const { return sweep % LOW_PRECISION_CHECK_EVERY == 0; }
+
+    // Records the residual of a due sweep. Returns true once it is down to
+    // the floor or has stalled: further 16-bit sweeps would only round.
+    bool done(float residual) {
+        if (residual < lowest) {
+            lowest = residual;
+            stalled = 0;
+        } else {
+            stalled++;
+        }
+        return residual <= floor || stalled >= LOW_PRECISION_PATIENCE;
+    }
+
+private:
+    float floor;
+    float lowest;
+    int stalled;
+};
+
+#endif
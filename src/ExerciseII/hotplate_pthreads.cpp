@@ -1,223 +1,407 @@
-#include <iostream>
-#include <pthread.h>
-#include <vector>
-#include <cstdlib>
-#include <cmath>
-#include <chrono>
-
-using namespace std;
-
-// Global simulation parameters and matrices.
-int row, col;
-int iter = 0;
-bool global_done = false;
-int num_threads;
-vector<bool> convergence_flags; // one per thread
-pthread_barrier_t barrier;
-
-vector<vector<float>> matrix1;
-vector<vector<float>> matrix2;
-
-// Structure passed to each thread.
-struct ThreadData {
-    int tid;
-    int start; // first row (inclusive) this thread will update
-    int end;   // last row (inclusive) this thread will update
-};
-
-// Initialization function (same as before).
-void initialize(int row, int col, vector<vector<float>> &mat) {
-    for (int i = 0; i < row; i++){
-        for (int j = 0; j < col; j++){
-            if (i == 0 || j == 0 || j == col - 1) {
-                mat[i][j] = 0.0f; // cold boundary
-            } else if (i == row - 1) {
-                mat[i][j] = 100.0f; // hot border
-            } else if (i == 400 || j < 500) { // hot region condition (as in your original code)
-                mat[i][j] = 100.0f;
-            } else if (i == 512 && j == 512) {
-                mat[i][j] = 100.0f; // hot center
-            } else {
-                mat[i][j] = 0.0f;
-            }
-        }
-    }
-}
-
-// Thread worker function.
-void* thread_func(void* arg) {
-    ThreadData* data = (ThreadData*) arg;
-    bool local_converged;
-    
-    while (true) {
-        // --- First sweep: update matrix2 from matrix1 ---
-        for (int i = data->start; i <= data->end; i++){
-            // Skip global boundary rows.
-            if(i == 0 || i == row - 1)
-                continue;
-            for (int j = 1; j < col - 1; j++){
-                // Skip fixed hot cells.
-                if ((i == 500 && j < 400) || (i == 512 && j == 512))
-                    continue;
-                matrix2[i][j] = (matrix1[i+1][j] + matrix1[i-1][j] +
-                                 matrix1[i][j+1] + matrix1[i][j-1] +
-                                 4 * matrix1[i][j]) / 8.0f;
-            }
-        }
-        pthread_barrier_wait(&barrier);
-        
-        // --- Convergence check on matrix2 ---
-        local_converged = true;
-        for (int i = data->start; i <= data->end; i++){
-            if(i == 0 || i == row - 1)
-                continue;
-            for (int j = 1; j < col - 1; j++){
-                if ((i == 500 && j < 400) || (i == 512 && j == 512))
-                    continue;
-                float conv = matrix2[i][j] - ((matrix2[i+1][j] + matrix2[i-1][j] +
-                                               matrix2[i][j+1] + matrix2[i][j-1]) / 4.0f);
-                if (fabs(conv) > 0.1f) {
-                    local_converged = false;
-                    break;
-                }
-            }
-            if (!local_converged)
-                break;
-        }
-        convergence_flags[data->tid] = local_converged;
-        pthread_barrier_wait(&barrier);
-        
-        // Thread 0 aggregates the convergence results.
-        if(data->tid == 0) {
-            bool all_converged = true;
-            for (int t = 0; t < num_threads; t++){
-                if (!convergence_flags[t]){
-                    all_converged = false;
-                    break;
-                }
-            }
-            global_done = all_converged;
-        }
-        pthread_barrier_wait(&barrier);
-        if (global_done)
-            break;
-        
-        // --- Second sweep: update matrix1 from matrix2 ---
-        for (int i = data->start; i <= data->end; i++){
-            if(i == 0 || i == row - 1)
-                continue;
-            for (int j = 1; j < col - 1; j++){
-                if ((i == 500 && j < 400) || (i == 512 && j == 512))
-                    continue;
-                matrix1[i][j] = (matrix2[i+1][j] + matrix2[i-1][j] +
-                                 matrix2[i][j+1] + matrix2[i][j-1] +
-                                 4 * matrix2[i][j]) / 8.0f;
-            }
-        }
-        pthread_barrier_wait(&barrier);
-        
-        // --- Convergence check on matrix1 ---
-        local_converged = true;
-        for (int i = data->start; i <= data->end; i++){
-            if(i == 0 || i == row - 1)
-                continue;
-            for (int j = 1; j < col - 1; j++){
-                if ((i == 500 && j < 400) || (i == 512 && j == 512))
-                    continue;
-                float conv = matrix1[i][j] - ((matrix1[i+1][j] + matrix1[i-1][j] +
-                                               matrix1[i][j+1] + matrix1[i][j-1]) / 4.0f);
-                if (fabs(conv) > 0.1f) {
-                    local_converged = false;
-                    break;
-                }
-            }
-            if (!local_converged)
-                break;
-        }
-        convergence_flags[data->tid] = local_converged;
-        pthread_barrier_wait(&barrier);
-        
-        if(data->tid == 0) {
-            bool all_converged = true;
-            for (int t = 0; t < num_threads; t++){
-                if (!convergence_flags[t]){
-                    all_converged = false;
-                    break;
-                }
-            }
-            global_done = all_converged;
-            iter++; // Count one full cycle (both sweeps)
-        }
-        pthread_barrier_wait(&barrier);
-        if (global_done)
-            break;
-    }
-    
-    pthread_exit(NULL);
-}
-
-int main(int argc, char* argv[]){
-    if (argc < 4) {
-        cerr << "Usage: " << argv[0] << " <rows> <cols> <num_threads>" << endl;
-        return 1;
-    }
-    
-    row = atoi(argv[1]);
-    col = atoi(argv[2]);
-    num_threads = atoi(argv[3]);
-    
-    // Allocate the matrices.
-    matrix1.resize(row, vector<float>(col, 0));
-    matrix2.resize(row, vector<float>(col, 0));
-    
-    // Initialize both matrices.
-    initialize(row, col, matrix1);
-    initialize(row, col, matrix2);
-    
-    convergence_flags.resize(num_threads, false);
-    pthread_barrier_init(&barrier, NULL, num_threads);
-    
-    // Create thread data and spawn threads.
-    vector<pthread_t> threads(num_threads);
-    vector<ThreadData> thread_data(num_threads);
-    
-    // Divide the interior rows (1 .. row-2) among threads.
-    int interior_rows = row - 2;
-    int rows_per_thread = interior_rows / num_threads;
-    int remainder = interior_rows % num_threads;
-    int current_start = 1;
-    for (int t = 0; t < num_threads; t++){
-        thread_data[t].tid = t;
-        int extra = (t < remainder) ? 1 : 0;
-        thread_data[t].start = current_start;
-        thread_data[t].end = current_start + rows_per_thread + extra - 1;
-        current_start = thread_data[t].end + 1;
-    }
-    
-    auto t_start = chrono::high_resolution_clock::now();
-    
-    for (int t = 0; t < num_threads; t++){
-        pthread_create(&threads[t], NULL, thread_func, (void*) &thread_data[t]);
-    }
-    for (int t = 0; t < num_threads; t++){
-        pthread_join(threads[t], NULL);
-    }
-    
-    auto t_end = chrono::high_resolution_clock::now();
-    double exec_time = chrono::duration<double>(t_end - t_start).count();
-    
-    int hot_cells = 0;
-    for (int i = 0; i < row; i++){
-        for (int j = 0; j < col; j++){
-            if (matrix1[i][j] > 50.0f)
-                hot_cells++;
-        }
-    }
-    
-    cout << "N° Iteraciones: " << iter << endl;
-    cout << "Tiempo de ejecucion: " << exec_time << " segundos" << endl;
-    cout << "Num. de celdas calientes: " << hot_cells << endl;
-    
-    pthread_barrier_destroy(&barrier);
-    return 0;
-}
+#include <iostream>
+#include <pthread.h>
+#include <vector>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <chrono>
+#include <atomic>
+#include <sched.h>
+
+#include "hotplate_checkpoint.h"
+#include "hotplate_grid.h"
+#include "hotplate_options.h"
+#include "hotplate_snapshot.h"
+
+using namespace std;
+
+// Global simulation parameters and matrices.
+int row, col;
+int iter = 0;
+bool global_done = false;
+int num_threads;
+vector<float> residuals; // max residual of each thread's rows
+pthread_barrier_t barrier;
+
+PlateGrid matrix1;
+PlateGrid matrix2;
+FixedCells fixed_cells; // fixed hot cells, restored after every sweep
+ConvergenceSchedule schedule; // which sweeps check convergence; updated by thread 0
+float omega; // relaxation factor of the red-black solvers
+long first_sweep = 0; // sweep the workers start after: 0, or that of the --restart checkpoint
+CheckpointWriter* checkpoint; // --checkpoint-every; --sync barrier only
+SnapshotWriter* snapshot;     // --snapshot-every; --sync barrier only
+
+// --sync neighbor: instead of barriers, each thread publishes how many steps
+// (sweeps, or colors for red-black) it has finished and waits only for the
+// two threads whose rows border its own. Checked sweeps still gather every
+// thread, through a counter, before the schedule decides.
+struct alignas(64) Epoch { atomic<long> value{0}; };
+struct alignas(64) ResidualSlot { float value; };
+Epoch* epochs;                 // steps finished by each thread
+ResidualSlot* residual_slots;  // residual of each thread at the current check
+atomic<long> arrivals(0);      // threads that reached a check, over all checks
+atomic<long> decided(0);       // checks whose outcome is in global_done
+
+// Structure passed to each thread.
+struct ThreadData {
+    int tid;
+    int start; // first row (inclusive) this thread will update
+    int end;   // last row (inclusive) this thread will update
+};
+
+// Largest of the per-thread residuals.
+float max_residual() {
+    float res = 0.0f;
+    for (int t = 0; t < num_threads; t++)
+        res = max(res, residuals[t]);
+    return res;
+}
+
+// Checkpoint of grid after sweep, taken by all the workers: thread 0 starts
+// it, every thread copies its rows to the staging buffer (thread 0 also the
+// border rows) and thread 0 writes it out in the background.
+void checkpoint_rows(const ThreadData* data, long sweep, const PlateGrid &grid) {
+    if (data->tid == 0)
+        checkpoint->begin(sweep, schedule);
+    pthread_barrier_wait(&barrier);
+    checkpoint->stage_rows(grid, data->start, data->end + 1);
+    if (data->tid == 0) {
+        checkpoint->stage_rows(grid, 0, 1);
+        checkpoint->stage_rows(grid, row - 1, row);
+    }
+    pthread_barrier_wait(&barrier);
+    if (data->tid == 0)
+        checkpoint->commit();
+}
+
+// Frame of grid after sweep, taken by all the workers: each thread sums its
+// share of the frame rows.
+void snapshot_rows(const ThreadData* data, long sweep, const PlateGrid &grid) {
+    if (data->tid == 0)
+        snapshot->begin(sweep);
+    pthread_barrier_wait(&barrier);
+    int rows = snapshot->rows();
+    snapshot->stage_rows(grid, (int) ((long long) rows * data->tid / num_threads),
+                         (int) ((long long) rows * (data->tid + 1) / num_threads));
+    pthread_barrier_wait(&barrier);
+    if (data->tid == 0)
+        snapshot->commit();
+}
+
+// Thread worker function. Sweeps that do not check convergence only need the
+// barrier that keeps the next sweep from reading rows still being written.
+void* thread_func(void* arg) {
+    ThreadData* data = (ThreadData*) arg;
+    float local_residual;
+    long sweep = first_sweep;
+    bool check, save, snap;
+    
+    while (true) {
+        // After --restart from an odd sweep the cycle resumes at its second
+        // sweep, so the matrices keep their roles; both hold the plate.
+        if (sweep % 2 == 0) {
+            // --- First sweep: update matrix2 from matrix1 ---
+            // Every thread decides on the checkpoint and the frame before
+            // thread 0 can start them.
+            check = schedule.due(++sweep);
+            save = checkpoint->due(sweep);
+            snap = snapshot->due(sweep);
+            local_residual = sweep_rows(fixed_cells, matrix1, matrix2, data->start, data->end + 1, check);
+            pthread_barrier_wait(&barrier);
+            if (snap)
+                snapshot_rows(data, sweep, matrix2);
+        
+            if (check) {
+                // --- Convergence check on matrix2: edge rows, now that the neighbours are written ---
+                local_residual = max(local_residual, edge_max_residual(fixed_cells, matrix2, data->start, data->end + 1));
+                residuals[data->tid] = local_residual;
+                pthread_barrier_wait(&barrier);
+            
+                // Thread 0 aggregates the convergence results.
+                if(data->tid == 0)
+                    global_done = schedule.converged(sweep, max_residual());
+                pthread_barrier_wait(&barrier);
+                if (global_done)
+                    break;
+            }
+            if (save)
+                checkpoint_rows(data, sweep, matrix2);
+        }
+        
+        // --- Second sweep: update matrix1 from matrix2 ---
+        check = schedule.due(++sweep);
+        save = checkpoint->due(sweep);
+        snap = snapshot->due(sweep);
+        local_residual = sweep_rows(fixed_cells, matrix2, matrix1, data->start, data->end + 1, check);
+        pthread_barrier_wait(&barrier);
+        if (snap)
+            snapshot_rows(data, sweep, matrix1);
+        
+        if (check) {
+            // --- Convergence check on matrix1: edge rows, now that the neighbours are written ---
+            local_residual = max(local_residual, edge_max_residual(fixed_cells, matrix1, data->start, data->end + 1));
+            residuals[data->tid] = local_residual;
+            pthread_barrier_wait(&barrier);
+            
+            if(data->tid == 0)
+                global_done = schedule.converged(sweep, max_residual());
+            pthread_barrier_wait(&barrier);
+        }
+        if (global_done)
+            break;
+        if (save)
+            checkpoint_rows(data, sweep, matrix1);
+    }
+    // One iteration per full cycle (both sweeps), counted from the first
+    // sweep even after --restart.
+    if(data->tid == 0)
+        iter = (int) (sweep / 2);
+    
+    pthread_exit(NULL);
+}
+
+// Red-black worker: sweeps matrix1 in place, one color at a time, with a
+// barrier after each color. Every sweep counts as an iteration.
+void* redblack_thread_func(void* arg) {
+    ThreadData* data = (ThreadData*) arg;
+    float local_residual;
+    long sweep = first_sweep;
+    bool check, save, snap;
+    
+    while (true) {
+        check = schedule.due(++sweep);
+        save = checkpoint->due(sweep);
+        snap = snapshot->due(sweep);
+        redblack_rows(fixed_cells, matrix1, data->start, data->end + 1, 0, 0, omega);
+        pthread_barrier_wait(&barrier);
+        local_residual = redblack_rows(fixed_cells, matrix1, data->start, data->end + 1, 0, 1, omega, check);
+        pthread_barrier_wait(&barrier);
+        if (snap)
+            snapshot_rows(data, sweep, matrix1);
+        if(data->tid == 0)
+            iter++;
+        
+        if (check) {
+            local_residual = max(local_residual, edge_max_residual(fixed_cells, matrix1, data->start, data->end + 1));
+            residuals[data->tid] = local_residual;
+            pthread_barrier_wait(&barrier);
+            
+            if(data->tid == 0)
+                global_done = schedule.converged(sweep, max_residual());
+            pthread_barrier_wait(&barrier);
+            if (global_done)
+                break;
+        }
+        if (save)
+            checkpoint_rows(data, sweep, matrix1);
+    }
+    
+    pthread_exit(NULL);
+}
+
+// Spins until counter reaches value, yielding the core after a short while so
+// that waiting threads do not starve the ones they wait for.
+void wait_until(const atomic<long> &counter, long value) {
+    for (int spins = 0; counter.load(memory_order_acquire) < value; spins++)
+        if (spins >= 64)
+            sched_yield();
+}
+
+// Waits until the threads owning the rows above and below have finished step.
+void wait_neighbors(int tid, long step) {
+    if (tid > 0)
+        wait_until(epochs[tid - 1].value, step);
+    if (tid < num_threads - 1)
+        wait_until(epochs[tid + 1].value, step);
+}
+
+// Convergence check `check` (1, 2, ...) of sweep: every thread leaves its
+// residual in its slot and counts itself in; the last to arrive combines the
+// slots, updates the schedule and publishes the outcome. No locks are taken.
+bool neighbor_converged(int tid, long sweep, long check, float residual) {
+    residual_slots[tid].value = residual;
+    if (arrivals.fetch_add(1, memory_order_acq_rel) == check * num_threads - 1) {
+        float res = 0.0f;
+        for (int t = 0; t < num_threads; t++)
+            res = max(res, residual_slots[t].value);
+        global_done = schedule.converged(sweep, res);
+        decided.store(check, memory_order_release);
+    } else {
+        wait_until(decided, check);
+    }
+    return global_done;
+}
+
+// Jacobi worker for --sync neighbor. Sweep s may start once both neighbours
+// have finished sweep s-1: their rows of the source are then written, and
+// they no longer read the rows this sweep overwrites. A thread can thus run
+// one sweep ahead of its neighbours, and further ahead of distant threads,
+// until the next check. Sweep s writes matrix2 when odd, matrix1 when even.
+void* neighbor_thread_func(void* arg) {
+    ThreadData* data = (ThreadData*) arg;
+    long checks = 0;
+    
+    for (long sweep = first_sweep + 1; ; sweep++) {
+        wait_neighbors(data->tid, sweep - 1);
+        bool check = schedule.due(sweep);
+        const PlateGrid &src = sweep % 2 ? matrix1 : matrix2;
+        PlateGrid &dst = sweep % 2 ? matrix2 : matrix1;
+        float local_residual = sweep_rows(fixed_cells, src, dst, data->start, data->end + 1, check);
+        epochs[data->tid].value.store(sweep, memory_order_release);
+        
+        if (check) {
+            // Nobody passes the check below before this thread, so the
+            // neighbours' rows stay at this sweep while the edges are read.
+            wait_neighbors(data->tid, sweep);
+            local_residual = max(local_residual, edge_max_residual(fixed_cells, dst, data->start, data->end + 1));
+            if (neighbor_converged(data->tid, sweep, ++checks, local_residual)) {
+                if (data->tid == 0)
+                    iter = (int) (sweep / 2); // as counted by thread_func
+                break;
+            }
+        }
+    }
+    
+    pthread_exit(NULL);
+}
+
+// Red-black worker for --sync neighbor. Step 2s-1 is color 0 of sweep s and
+// step 2s color 1; a color may start once both neighbours have finished the
+// previous one.
+void* neighbor_redblack_thread_func(void* arg) {
+    ThreadData* data = (ThreadData*) arg;
+    long checks = 0;
+    
+    for (long sweep = first_sweep + 1; ; sweep++) {
+        bool check = schedule.due(sweep);
+        wait_neighbors(data->tid, 2 * sweep - 2);
+        redblack_rows(fixed_cells, matrix1, data->start, data->end + 1, 0, 0, omega);
+        epochs[data->tid].value.store(2 * sweep - 1, memory_order_release);
+        wait_neighbors(data->tid, 2 * sweep - 1);
+        float local_residual = redblack_rows(fixed_cells, matrix1, data->start, data->end + 1, 0, 1, omega, check);
+        epochs[data->tid].value.store(2 * sweep, memory_order_release);
+        
+        if (check) {
+            wait_neighbors(data->tid, 2 * sweep);
+            local_residual = max(local_residual, edge_max_residual(fixed_cells, matrix1, data->start, data->end + 1));
+            if (neighbor_converged(data->tid, sweep, ++checks, local_residual)) {
+                if (data->tid == 0)
+                    iter = (int) sweep;
+                break;
+            }
+        }
+    }
+    
+    pthread_exit(NULL);
+}
+
+int main(int argc, char* argv[]){
+    HotplateOptions opts;
+    // Synchronization of the workers: barriers (default) or neighbour epochs.
+    const char *sync = take_option(argc, argv, "--sync");
+    bool neighbor = sync && strcmp(sync, "neighbor") == 0;
+    if (!parse_hotplate_options(argc, argv, opts))
+        return 1;
+    if (sync && !neighbor && strcmp(sync, "barrier") != 0) {
+        cerr << "Error: --sync must be barrier or neighbor" << endl;
+        return 1;
+    }
+    if (opts.time_block > 1) {
+        cerr << "Error: --time-block is only available in the sequential and OpenMP versions" << endl;
+        return 1;
+    }
+    if (opts.storage != STORAGE_FP32) {
+        cerr << "Error: --storage is only available in the sequential and OpenMP versions" << endl;
+        return 1;
+    }
+    if (opts.solver == SOLVER_MULTIGRID) {
+        cerr << "Error: --solver multigrid is only available in the sequential and OpenMP versions" << endl;
+        return 1;
+    }
+    if (neighbor && (opts.checkpoint_every > 0 || opts.snapshot_every > 0)) {
+        cerr << "Error: --checkpoint-every and --snapshot-every need --sync barrier" << endl;
+        return 1;
+    }
+    if (argc < 4) {
+        cerr << "Usage: " << argv[0] << " <rows> <cols> <num_threads>" << HOTPLATE_OPTIONS_USAGE
+             << " [--sync barrier|neighbor]" << endl;
+        return 1;
+    }
+    
+    row = atoi(argv[1]);
+    col = atoi(argv[2]);
+    num_threads = atoi(argv[3]);
+    
+    // Allocate the matrices.
+    matrix1.allocate(row, col);
+    matrix2.allocate(row, col);
+    fixed_cells = plate_fixed_cells(opts.scenario, row, col, 0, 1, row - 1);
+    schedule = ConvergenceSchedule(opts);
+    omega = opts.relaxation(row, col);
+    
+    // Initialize both matrices.
+    initialize_plate(matrix1, opts.scenario, row, 0, 0, row);
+    initialize_plate(matrix2, opts.scenario, row, 0, 0, row);
+    PlateGrid* const grids[2] = {&matrix1, &matrix2};
+    if (opts.restart && (first_sweep = load_checkpoint(opts.checkpoint_path, row, col, opts.solver, grids, 2, schedule)) < 0)
+        return 1;
+    if (opts.red_black())
+        iter = (int) first_sweep;
+    checkpoint = new CheckpointWriter(opts, row, col, first_sweep);
+    snapshot = new SnapshotWriter(opts, row, col, first_sweep);
+    
+    residuals.resize(num_threads, 0.0f);
+    pthread_barrier_init(&barrier, NULL, num_threads);
+    epochs = new Epoch[num_threads];
+    for (int t = 0; t < num_threads; t++)
+        epochs[t].value = opts.red_black() ? 2 * first_sweep : first_sweep;
+    residual_slots = new ResidualSlot[num_threads];
+    
+    // Create thread data and spawn threads.
+    vector<pthread_t> threads(num_threads);
+    vector<ThreadData> thread_data(num_threads);
+    
+    // Divide the interior rows (1 .. row-2) among threads.
+    int interior_rows = row - 2;
+    int rows_per_thread = interior_rows / num_threads;
+    int remainder = interior_rows % num_threads;
+    int current_start = 1;
+    for (int t = 0; t < num_threads; t++){
+        thread_data[t].tid = t;
+        int extra = (t < remainder) ? 1 : 0;
+        thread_data[t].start = current_start;
+        thread_data[t].end = current_start + rows_per_thread + extra - 1;
+        current_start = thread_data[t].end + 1;
+    }
+    
+    auto t_start = chrono::high_resolution_clock::now();
+    
+    void* (*worker)(void*);
+    if (neighbor)
+        worker = opts.red_black() ? neighbor_redblack_thread_func : neighbor_thread_func;
+    else
+        worker = opts.red_black() ? redblack_thread_func : thread_func;
+    for (int t = 0; t < num_threads; t++){
+        pthread_create(&threads[t], NULL, worker, (void*) &thread_data[t]);
+    }
+    for (int t = 0; t < num_threads; t++){
+        pthread_join(threads[t], NULL);
+    }
+    
+    auto t_end = chrono::high_resolution_clock::now();
+    double exec_time = chrono::duration<double>(t_end - t_start).count();
+    
+    int hot_cells = count_hot_cells(matrix1, 0, row);
+    
+    cout << "N° Iteraciones: " << iter << endl;
+    cout << "Tiempo de ejecucion: " << exec_time << " segundos" << endl;
+    cout << "Num. de celdas calientes: " << hot_cells << endl;
+    
+    pthread_barrier_destroy(&barrier);
+    delete checkpoint;
+    delete snapshot;
+    delete[] epochs;
+    delete[] residual_slots;
+    return 0;
+}
@@ -0,0 +1,158 @@
+#ifndef HOTPLATE_SCENARIO_H
+#define HOTPLATE_SCENARIO_H
+
+// Plate geometry of the ExerciseII solvers: border temperatures, starting
+// values and fixed (held) cells of the interior, and the convergence
+// tolerance. The built-in scenario is the plate of the original exercise;
+// --scenario FILE reads another one from a text file, one item per line:
+//
+//   tolerance T                  convergence tolerance
+//   border top|bottom|left|right V
+//   interior V                   starting value of the interior cells
+//   initial rect R0 C0 R1 C1 V   cells R0..R1 x C0..C1 start at V
+//   initial point R C V
+//   fixed rect R0 C0 R1 C1 V     cells R0..R1 x C0..C1 are held at V
+//   fixed point R C V
+//
+// Coordinates are global and inclusive; a negative one counts from the end
+// (-1 is the last row or column). Rectangles and points are clipped to the
+// interior, and where they overlap the later line wins, fixed or not. The
+// left and right borders take the corners. Text after '#' is a comment.
+//
+// The solvers never look at the scenario while sweeping: it is turned once
+// into the initial grids and the FixedCells list (hotplate_grid.h).
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Default convergence tolerance: the plate has converged when every
+// non-fixed interior cell has |c - (n+s+e+w)/4| <= tolerance.
+const float CONVERGENCE_TOLERANCE = 0.1f;
+
+struct PlateRegion {
+    int row_begin, col_begin, row_end, col_end; // inclusive; negative counts from the end
+    float value;
+    bool fixed;
+};
+
+struct Scenario {
+    float top, bottom, left, right;
+    float interior;
+    float tolerance;
+    std::vector<PlateRegion> regions; // in file order; later ones win
+
+    // The plate of the original exercise: a hot bottom border, hot columns
+    // 1..499 and row 400, row 500 held hot up to column 399 and a hot point
+    // held at (512, 512).
+    Scenario() : top(0.0f), bottom(100.0f), left(0.0f), right(0.0f), interior(0.0f),
+                 tolerance(CONVERGENCE_TOLERANCE) {
+        regions.push_back(PlateRegion{400, 0, 400, -1, 100.0f, false});
+        regions.push_back(PlateRegion{0, 0, -1, 499, 100.0f, false});
+        regions.push_back(PlateRegion{500, 0, 500, 399, 100.0f, true});
+        regions.push_back(PlateRegion{512, 512, 512, 512, 100.0f, true});
+    }
+
+    // Initial values of columns [col_begin, col_end) of global row r of a
+    // rows x cols plate into values[0 ..], and whether each is held into
+    // held[0 ..] when held is not null.
+    void row_cells(int rows, int cols, int r, int col_begin, int col_end, float *values,
+                   unsigned char *held = nullptr) const {
+        bool edge = r == 0 || r == rows - 1;
+        for (int c = col_begin; c < col_end; c++) {
+            float v = edge ? (r == 0 ? top : bottom) : interior;
+            if (c == 0)
+                v = left;
+            else if (c == cols - 1)
+                v = right;
+            values[c - col_begin] = v;
+            if (held)
+                held[c - col_begin] = 0;
+        }
+        if (edge)
+            return;
+        for (const PlateRegion &reg : regions) {
+            if (r < at(reg.row_begin, rows) || r > at(reg.row_end, rows))
+                continue;
+            int c0 = std::max(std::max(at(reg.col_begin, cols), 1), col_begin);
+            int c1 = std::min(std::min(at(reg.col_end, cols) + 1, cols - 1), col_end);
+            for (int c = c0; c < c1; c++) {
+                values[c - col_begin] = reg.value;
+                if (held)
+                    held[c - col_begin] = reg.fixed;
+            }
+        }
+    }
+
+private:
+    static int at(int k, int n) { return k < 0 ? n + k : k; }
+};
+
+// Reads a scenario file over the built-in defaults; its regions replace the
+// built-in ones. Prints an error and returns false when the file cannot be
+// read or a line is not understood.
+inline bool load_scenario(const char *path, Scenario &sc) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Error: cannot open scenario file " << path << std::endl;
+        return false;
+    }
+    sc.regions.clear();
+    std::string line;
+    for (int lineno = 1; std::getline(in, line); lineno++) {
+        size_t hash = line.find('#');
+        if (hash != std::string::npos)
+            line.erase(hash);
+        std::istringstream ls(line);
+        std::string key, what;
+        if (!(ls >> key))
+            continue;
+        bool ok;
+        if (key == "tolerance") {
+            ok = (bool) (ls >> sc.tolerance) && sc.tolerance > 0.0f;
+        } else if (key == "interior") {
+            ok = (bool) (ls >> sc.interior);
+        } else if (key == "border") {
+            float *side = nullptr;
+            ok = (bool) (ls >> what);
+            if (what == "top")
+                side = &sc.top;
+            else if (what == "bottom")
+                side = &sc.bottom;
+            else if (what == "left")
+                side = &sc.left;
+            else if (what == "right")
+                side = &sc.right;
+            ok = ok && side && (ls >> *side);
+        } else if (key == "initial" || key == "fixed") {
+            PlateRegion reg;
+            reg.fixed = key == "fixed";
+            ok = (bool) (ls >> what);
+            if (what == "rect") {
+                ok = ok && (ls >> reg.row_begin >> reg.col_begin >> reg.row_end >> reg.col_end >> reg.value);
+            } else if (what == "point") {
+                ok = ok && (ls >> reg.row_begin >> reg.col_begin >> reg.value);
+                reg.row_end = reg.row_begin;
+                reg.col_end = reg.col_begin;
+            } else {
+                ok = false;
+            }
+            if (ok)
+                sc.regions.push_back(reg);
+        } else {
+            ok = false;
+        }
+        if (ok && (ls >> what))
+            ok = false; // trailing words
+        if (!ok) {
+            std::cerr << "Error: " << path << ":" << lineno << ": cannot understand '" << line << "'" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif
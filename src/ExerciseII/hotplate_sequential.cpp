@@ -1,103 +1,169 @@
-#include <iostream>
-#include <vector>
-#include <cmath>
-#include <chrono>
-#include <cstdlib>
-
-using namespace std;
-
-void initialize(int row, int col, vector<vector<float>>& arr) {
-    for (int i = 0; i < row; i++){
-        for (int j = 0; j < col; j++){
-            if (i == 0 || j == 0 || j == (col - 1)) {
-                arr[i][j] = 0.0f; // cold boundary
-            } else if (i == (row - 1)) {
-                arr[i][j] = 100.0f; // hot border
-            } else if (i == 400 || j < 500) {
-                arr[i][j] = 100.0f; // hot region (check logic if needed)
-            } else if (i == 512 && j == 512) {
-                arr[i][j] = 100.0f; // hot center
-            } else {
-                arr[i][j] = 0.0f; // cold by default
-            }
-        }
-    }
-}
-
-void new_values(int row, int col, vector<vector<float>>& arr2, const vector<vector<float>>& arr1) {
-    for (int i = 1; i < row - 1; i++){
-        for (int j = 1; j < col - 1; j++){
-            if ((i == 500 && j < 400) || (i == 512 && j == 512))
-                continue;
-            arr2[i][j] = (arr1[i+1][j] + arr1[i-1][j] +
-                          arr1[i][j+1] + arr1[i][j-1] +
-                          4 * arr1[i][j]) / 8.0f;
-        }
-    }
-}
-
-int check_convergence(int row, int col, const vector<vector<float>>& arr) {
-    float convergence;
-    for (int i = 1; i < row - 1; i++){
-        for (int j = 1; j < col - 1; j++){
-            if ((i == 500 && j < 400) || (i == 512 && j == 512))
-                continue;
-            convergence = arr[i][j] - ((arr[i+1][j] + arr[i-1][j] +
-                                        arr[i][j+1] + arr[i][j-1]) / 4.0f);
-            if (fabs(convergence) > 0.1f)
-                return 1;
-        }
-    }
-    return 0;
-}
-
-int main(int argc, char* argv[]){
-    if (argc < 3) {
-        cerr << "Usage: " << argv[0] << " <rows> <cols>" << endl;
-        return 1;
-    }
-
-    int iter = 0;
-    int status1 = 1, status2 = 1;
-    int hot_cells = 0;
-    int row = atoi(argv[1]);
-    int col = atoi(argv[2]);
-    
-    vector<vector<float>> matrix1(row, vector<float>(col, 0));
-    vector<vector<float>> matrix2(row, vector<float>(col, 0));
-    
-    auto t_start = chrono::high_resolution_clock::now();
-
-    initialize(row, col, matrix1);
-    initialize(row, col, matrix2);
-
-    while (true) {
-        new_values(row, col, matrix2, matrix1);
-        status1 = check_convergence(row, col, matrix2);
-        iter++;
-        if (status1 == 0)
-            break;
-
-        new_values(row, col, matrix1, matrix2);
-        status2 = check_convergence(row, col, matrix1);
-        iter++;
-        if (status2 == 0)
-            break;
-    }
-
-    for (int i = 0; i < row; i++){
-        for (int j = 0; j < col; j++){
-            if (matrix1[i][j] > 50.0f)
-                hot_cells++;
-        }
-    }
-
-    auto t_end = chrono::high_resolution_clock::now();
-    double exec_time = chrono::duration<double>(t_end - t_start).count();
-
-    cout << "N° Iteraciones: " << iter << endl;
-    cout << "Tiempo de ejecucion: " << exec_time << " segundos" << endl;
-    cout << "Num. de celdas calientes: " << hot_cells << endl;
-    
-    return 0;
-}
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <chrono>
+#include <cstdlib>
+
+#include "hotplate_grid.h"
+#include "hotplate_blocking.h"
+#include "hotplate_checkpoint.h"
+#include "hotplate_multigrid.h"
+#include "hotplate_options.h"
+#include "hotplate_precision.h"
+#include "hotplate_snapshot.h"
+
+using namespace std;
+
+// Updates arr2 from arr1. With check, returns the max residual of the new values.
+float new_values(int row, PlateGrid& arr2, const PlateGrid& arr1, const FixedCells& fixed_cells, bool check) {
+    float residual = sweep_rows(fixed_cells, arr1, arr2, 1, row - 1, check);
+    if (!check)
+        return residual;
+    return max(residual, edge_max_residual(fixed_cells, arr2, 1, row - 1));
+}
+
+// One red-black sweep of arr in place. With check, returns the max residual of the new values.
+float redblack_values(int row, PlateGrid& arr, const FixedCells& fixed_cells, float omega, bool check) {
+    redblack_rows(fixed_cells, arr, 1, row - 1, 0, 0, omega);
+    float residual = redblack_rows(fixed_cells, arr, 1, row - 1, 0, 1, omega, check);
+    if (!check)
+        return residual;
+    return max(residual, edge_max_residual(fixed_cells, arr, 1, row - 1));
+}
+
+// Runs sweeps first+1 .. first+n in temporal blocks of up to `steps` sweeps;
+// sweep s writes grids[s % 2]. Returns the number of the last sweep.
+int advance_blocked(int row, PlateGrid* const grids[2], const FixedCells& fixed_cells, int first, int n, int steps) {
+    while (n > 0) {
+        TimeBlockPlan plan = plan_time_block(*grids[0], 1, row - 1, min(n, steps));
+        for (int k = 0; k < plan.ntiles; k++)
+            time_block_tile(fixed_cells, grids, first, plan, k);
+        for (int k = 1; k < plan.ntiles; k++)
+            time_block_seam(fixed_cells, grids, first, plan, k);
+        first += plan.steps;
+        n -= plan.steps;
+    }
+    return first;
+}
+
+// Jacobi sweeps on 16-bit copies of the plate in grids[0], until the schedule
+// hands over to fp32; sweep s writes halves[s % 2]. The plate of the last sweep
+// is widened into grids[s % 2]. Returns the number of sweeps.
+int low_precision_sweeps(int row, int col, PlateGrid* const grids[2], const FixedCells& fixed_cells,
+                         const HotplateOptions& opts) {
+    HalfGrid half1(row, col, opts.storage);
+    HalfGrid half2(row, col, opts.storage);
+    HalfGrid* const halves[2] = {&half1, &half2};
+    narrow_plate_rows(*grids[0], half1, 0, row);
+    narrow_plate_rows(*grids[0], half2, 0, row);
+    LowPrecisionSchedule schedule(opts, opts.storage);
+    int sweep = 0;
+    while (true) {
+        bool check = schedule.due(sweep + 1);
+        float residual = half_sweep_rows(fixed_cells, *halves[sweep % 2], *halves[(sweep + 1) % 2], 1, row - 1, check);
+        sweep++;
+        if (check && schedule.done(max(residual, half_edge_max_residual(fixed_cells, *halves[sweep % 2], 1, row - 1))))
+            break;
+    }
+    widen_plate_rows(fixed_cells, *halves[sweep % 2], *grids[sweep % 2], 1, row - 1);
+    return sweep;
+}
+
+int main(int argc, char* argv[]){
+    HotplateOptions opts;
+    if (!parse_hotplate_options(argc, argv, opts))
+        return 1;
+    if (argc < 3) {
+        cerr << "Usage: " << argv[0] << " <rows> <cols>" << HOTPLATE_OPTIONS_USAGE << endl;
+        return 1;
+    }
+
+    int iter = 0;
+    float residual;
+    bool check;
+    ConvergenceSchedule schedule(opts);
+    int hot_cells = 0;
+    int row = atoi(argv[1]);
+    int col = atoi(argv[2]);
+    
+    PlateGrid matrix1(row, col);
+    PlateGrid matrix2(row, col);
+    FixedCells fixed_cells = plate_fixed_cells(opts.scenario, row, col, 0, 1, row - 1);
+    
+    auto t_start = chrono::high_resolution_clock::now();
+
+    initialize_plate(matrix1, opts.scenario, row, 0, 0, row);
+    initialize_plate(matrix2, opts.scenario, row, 0, 0, row);
+
+    // --restart continues from the sweep of the checkpoint, with both grids
+    // holding its plate.
+    PlateGrid* const grids[2] = {&matrix1, &matrix2};
+    if (opts.restart) {
+        long sweep = load_checkpoint(opts.checkpoint_path, row, col, opts.solver, grids, 2, schedule);
+        if (sweep < 0)
+            return 1;
+        iter = (int) sweep;
+    }
+    CheckpointWriter checkpoint(opts, row, col, iter);
+    SnapshotWriter snapshot(opts, row, col, iter);
+
+    if (opts.solver == SOLVER_MULTIGRID) {
+        // Multigrid cycles work on matrix1 in place; each cycle counts.
+        Multigrid mg(fixed_cells, row, col, opts.cycle_gamma);
+        while (true) {
+            mg.cycle(matrix1);
+            iter++;
+            if (snapshot.due(iter))
+                snapshot.save(iter, matrix1);
+            if (schedule.due(iter) && schedule.converged(iter, max_residual_rows(fixed_cells, matrix1, 1, row - 1)))
+                break;
+            if (checkpoint.due(iter))
+                checkpoint.save(iter, schedule, matrix1);
+        }
+    } else if (opts.red_black()) {
+        // Red-black sweeps work on matrix1 in place.
+        float omega = opts.relaxation(row, col);
+        while (true) {
+            check = schedule.due(iter + 1);
+            residual = redblack_values(row, matrix1, fixed_cells, omega, check);
+            iter++;
+            if (snapshot.due(iter))
+                snapshot.save(iter, matrix1);
+            if (check && schedule.converged(iter, residual))
+                break;
+            if (checkpoint.due(iter))
+                checkpoint.save(iter, schedule, matrix1);
+        }
+    } else {
+        // Sweep s writes grids[s % 2], so the odd sweeps go to matrix2. With
+        // 16-bit storage the first sweeps run on 16-bit copies.
+        if (opts.storage != STORAGE_FP32)
+            iter = low_precision_sweeps(row, col, grids, fixed_cells, opts);
+        while (true) {
+            // With temporal blocking, the sweeps up to the next check run in blocks.
+            if (opts.time_block > 1)
+                iter = advance_blocked(row, grids, fixed_cells, iter, schedule.next_due() - 1 - iter, opts.time_block);
+
+            check = schedule.due(iter + 1);
+            residual = new_values(row, *grids[(iter + 1) % 2], *grids[iter % 2], fixed_cells, check);
+            iter++;
+            if (snapshot.due(iter))
+                snapshot.save(iter, *grids[iter % 2]);
+            if (check && schedule.converged(iter, residual))
+                break;
+            if (checkpoint.due(iter))
+                checkpoint.save(iter, schedule, *grids[iter % 2]);
+        }
+    }
+
+    hot_cells = count_hot_cells(matrix1, 0, row);
+
+    auto t_end = chrono::high_resolution_clock::now();
+    double exec_time = chrono::duration<double>(t_end - t_start).count();
+
+    cout << "N° Iteraciones: " << iter << endl;
+    cout << "Tiempo de ejecucion: " << exec_time << " segundos" << endl;
+    cout << "Num. de celdas calientes: " << hot_cells << endl;
+    
+    return 0;
+}
@@ -0,0 +1,210 @@
+#ifndef HOTPLATE_SNAPSHOT_H
+#define HOTPLATE_SNAPSHOT_H
+
+// Snapshots of the temperature field while a hotplate solve runs, for
+// visualization.
+//
+// --snapshot-every N appends a frame of the plate to a stream file every N
+// sweeps (cycles, for multigrid). The file is a 64-byte header followed by
+// the frames; each frame is the sweep number (int64) and rows x cols float32
+// temperatures, row-major. With --snapshot-stride S a frame cell is the mean
+// of an S x S block of plate cells (smaller along the bottom and right
+// edges), so the frames are ceil(plate_rows / S) x ceil(plate_cols / S).
+//
+// The solver only adds the plate into one of two frame buffers; a
+// background thread turns the sums into means and writes the frame out while
+// the solver fills the other buffer. The solver only waits when both
+// buffers are still queued.
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "hotplate_grid.h"
+#include "hotplate_options.h"
+
+static const char SNAPSHOT_MAGIC[8] = {'H', 'P', 'S', 'N', 'A', 'P', '0', '1'};
+
+struct SnapshotHeader {
+    char magic[8];         // SNAPSHOT_MAGIC
+    int32_t plate_rows, plate_cols;
+    int32_t stride;        // plate cells per frame cell along each side
+    int32_t rows, cols;    // of each frame
+    int32_t reserved0;
+    uint8_t reserved[32];
+};
+static_assert(sizeof(SnapshotHeader) == 64, "snapshot header must stay 64 bytes");
+
+// Adds the plate cells of global rows [row_begin, row_end) by global columns
+// [col_begin, col_end) to the sums of the frame cells they fall in. grid(i, j)
+// holds global cell (i + row_offset, j + col_offset); sums[(fi - frame_row) *
+// frame_width + fj - frame_col] is the sum of frame cell (fi, fj). With
+// stride 1 each frame cell is a single plate cell, which is copied.
+inline void add_plate_cells(const PlateGrid &grid, int row_offset, int col_offset, int row_begin, int row_end,
+                            int col_begin, int col_end, int stride, float *sums, int frame_row, int frame_col,
+                            int frame_width) {
+    for (int r = row_begin; r < row_end; r++) {
+        const float *src = grid.row(r - row_offset) - col_offset;
+        float *dst = sums + (size_t) (r / stride - frame_row) * frame_width - frame_col;
+        if (stride == 1) {
+            memcpy(dst + col_begin, src + col_begin, (col_end - col_begin) * sizeof(float));
+            continue;
+        }
+        for (int c = col_begin; c < col_end; c++)
+            dst[c / stride] += src[c];
+    }
+}
+
+// Takes frames of a plate_rows x plate_cols plate and writes them to the
+// snapshot stream in the background.
+class SnapshotWriter {
+public:
+    // A writer with opt.snapshot_every == 0 never takes frames. first_sweep
+    // is the sweep the run starts from. A writer without output only follows
+    // the schedule of frames: begin() returns nullptr and nothing is written
+    // (the MPI ranks other than 0).
+    SnapshotWriter(const HotplateOptions &opt, int plate_rows, int plate_cols, long first_sweep, bool output = true)
+        : every(opt.snapshot_every), saved(first_sweep), stride(opt.snapshot_stride),
+          plate_rows(plate_rows), plate_cols(plate_cols),
+          frame_rows((plate_rows + stride - 1) / stride), frame_cols((plate_cols + stride - 1) / stride),
+          file(nullptr), filling(0), current(0), stopping(false) {
+        queued[0] = queued[1] = false;
+        if (every <= 0 || !output)
+            return;
+        for (int k = 0; k < 2; k++)
+            buffers[k].resize((size_t) frame_rows * frame_cols);
+        file = fopen(opt.snapshot_path, "wb");
+        if (!file) {
+            std::cerr << "Warning: cannot write snapshots to " << opt.snapshot_path << std::endl;
+        } else {
+            SnapshotHeader h;
+            memset(&h, 0, sizeof(h));
+            memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+            h.plate_rows = plate_rows;
+            h.plate_cols = plate_cols;
+            h.stride = stride;
+            h.rows = frame_rows;
+            h.cols = frame_cols;
+            fwrite(&h, sizeof(h), 1, file);
+        }
+        worker = std::thread(&SnapshotWriter::write_frames, this);
+    }
+    ~SnapshotWriter() { finish(); }
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    // Whether a frame is due after sweep: the first sweep a solver offers
+    // once a multiple of the interval has passed since the last frame.
+    bool due(long sweep) const { return every > 0 && sweep / every > saved / every; }
+
+    int rows() const { return frame_rows; }
+    int cols() const { return frame_cols; }
+
+    // Starts the frame of sweep: waits for a free buffer and returns it, or
+    // nullptr without output. Called by one thread.
+    float* begin(long sweep) {
+        saved = sweep;
+        if (buffers[0].empty())
+            return nullptr;
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return !queued[filling]; });
+        current = filling;
+        sweeps[current] = sweep;
+        return buffers[current].data();
+    }
+
+    // Sums of frame rows [row_begin, row_end) of the frame being taken, from
+    // the whole plate in grid. Threads may stage disjoint frame rows at the
+    // same time.
+    void stage_rows(const PlateGrid &grid, int row_begin, int row_end) {
+        if (buffers[0].empty() || row_begin >= row_end)
+            return;
+        float *sums = &buffers[current][(size_t) row_begin * frame_cols];
+        std::fill(sums, sums + (size_t) (row_end - row_begin) * frame_cols, 0.0f);
+        add_plate_cells(grid, 0, 0, row_begin * stride, std::min(row_end * stride, plate_rows), 0, plate_cols,
+                        stride, sums, row_begin, 0, frame_cols);
+    }
+
+    // Queues the frame for writing. Called by one thread.
+    void commit() {
+        if (buffers[0].empty())
+            return;
+        std::lock_guard<std::mutex> lock(mutex);
+        queued[current] = true;
+        filling = 1 - current;
+        changed.notify_all();
+    }
+
+    // begin(), stage_rows() of the whole frame and commit() from one thread.
+    void save(long sweep, const PlateGrid &grid) {
+        begin(sweep);
+        stage_rows(grid, 0, frame_rows);
+        commit();
+    }
+
+    // Writes out the queued frames and closes the stream.
+    void finish() {
+        if (!worker.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            changed.notify_all();
+        }
+        worker.join();
+        if (file)
+            fclose(file);
+        file = nullptr;
+    }
+
+private:
+    long every, saved;
+    int stride, plate_rows, plate_cols, frame_rows, frame_cols;
+    FILE *file;
+    std::vector<float> buffers[2];
+    long sweeps[2];
+    bool queued[2];
+    int filling, current; // buffer the next frame goes to, and the one being taken
+    bool stopping;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::thread worker;
+
+    // Background thread: writes the buffers out in the order they were
+    // queued, which alternates, until finish() and the queue is empty.
+    void write_frames() {
+        for (int k = 0; ; k = 1 - k) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this, k] { return queued[k] || stopping; });
+                if (!queued[k])
+                    return;
+            }
+            float *frame = buffers[k].data();
+            if (stride > 1) {
+                for (int i = 0; i < frame_rows; i++) {
+                    int h = std::min(stride, plate_rows - i * stride);
+                    for (int j = 0; j < frame_cols; j++)
+                        frame[(size_t) i * frame_cols + j] /= (float) (h * std::min(stride, plate_cols - j * stride));
+                }
+            }
+            if (file) {
+                int64_t sweep = sweeps[k];
+                fwrite(&sweep, sizeof(sweep), 1, file);
+                fwrite(frame, sizeof(float), buffers[k].size(), file);
+                fflush(file);
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            queued[k] = false;
+            changed.notify_all();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef HOTPLATE_SNAPSHOT_MPI_H
+#define HOTPLATE_SNAPSHOT_MPI_H
+
+// Snapshots of the MPI and hybrid versions, in the stream format of
+// hotplate_snapshot.h.
+//
+// Each rank adds its part of the plate to the sums of the frame cells it
+// overlaps, which with --snapshot-stride S > 1 is a much smaller array than
+// its block. Rank 0 gathers the sums with MPI_Gatherv, adds them up into a
+// frame and queues it on its SnapshotWriter, whose thread does the writing.
+
+#include <mpi.h>
+#include <algorithm>
+#include <vector>
+
+#include "hotplate_grid.h"
+#include "hotplate_halo.h"
+#include "hotplate_options.h"
+#include "hotplate_snapshot.h"
+
+class BlockSnapshot {
+public:
+    // Collective over block.comm; see SnapshotWriter for the arguments.
+    BlockSnapshot(const HotplateOptions &opt, int global_rows, int global_cols, const LocalBlock &block,
+                  long first_sweep)
+        : writer(opt, global_rows, global_cols, first_sweep, rank_of(block.comm) == 0),
+          stride(opt.snapshot_stride), comm(block.comm) {
+        if (opt.snapshot_every <= 0)
+            return;
+        int rb, re, cb, ce;
+        block_plate_cells(block, rb, re, cb, ce);
+        row_offset = block.row_offset;
+        col_offset = block.col_offset;
+        rows[0] = rb + row_offset;
+        rows[1] = re + row_offset;
+        cols[0] = cb + col_offset;
+        cols[1] = ce + col_offset;
+        // Frame cells overlapped by the block: rows and columns [begin, end).
+        int rect[4] = {rows[0] / stride, (rows[1] - 1) / stride + 1, cols[0] / stride, (cols[1] - 1) / stride + 1};
+        sums.resize((size_t) (rect[1] - rect[0]) * (rect[3] - rect[2]));
+        for (int k = 0; k < 4; k++)
+            frame_rect[k] = rect[k];
+
+        int nprocs;
+        MPI_Comm_size(comm, &nprocs);
+        if (rank_of(comm) == 0)
+            rects.resize(4 * nprocs);
+        MPI_Gather(rect, 4, MPI_INT, rects.data(), 4, MPI_INT, 0, comm);
+        if (rank_of(comm) == 0) {
+            counts.resize(nprocs);
+            displs.resize(nprocs);
+            int total = 0;
+            for (int p = 0; p < nprocs; p++) {
+                counts[p] = (rects[4 * p + 1] - rects[4 * p]) * (rects[4 * p + 3] - rects[4 * p + 2]);
+                displs[p] = total;
+                total += counts[p];
+            }
+            gathered.resize(total);
+        }
+    }
+
+    bool due(long sweep) const { return writer.due(sweep); }
+
+    // Frame of grid after sweep. Collective over the ranks of the block.
+    void save(long sweep, const PlateGrid &grid) {
+        int width = frame_rect[3] - frame_rect[2];
+        std::fill(sums.begin(), sums.end(), 0.0f);
+        add_plate_cells(grid, row_offset, col_offset, rows[0], rows[1], cols[0], cols[1], stride, sums.data(),
+                        frame_rect[0], frame_rect[2], width);
+        MPI_Gatherv(sums.data(), (int) sums.size(), MPI_FLOAT, gathered.data(), counts.data(), displs.data(),
+                    MPI_FLOAT, 0, comm);
+        float *frame = writer.begin(sweep);
+        if (!frame)
+            return;
+        std::fill(frame, frame + (size_t) writer.rows() * writer.cols(), 0.0f);
+        for (size_t p = 0; p < counts.size(); p++) {
+            const int *r = &rects[4 * p];
+            const float *src = &gathered[displs[p]];
+            for (int i = r[0]; i < r[1]; i++)
+                for (int j = r[2]; j < r[3]; j++)
+                    frame[(size_t) i * writer.cols() + j] += *src++;
+        }
+        writer.commit();
+    }
+
+    // Writes out the queued frames.
+    void finish() { writer.finish(); }
+
+private:
+    SnapshotWriter writer;
+    int stride;
+    MPI_Comm comm;
+    int row_offset, col_offset;
+    int rows[2], cols[2];   // global plate cells of this rank, [begin, end)
+    int frame_rect[4];      // frame cells they fall in: rows, then columns, [begin, end)
+    std::vector<float> sums;
+    std::vector<int> rects, counts, displs; // rank 0: frame_rect, size and place of every rank's sums
+    std::vector<float> gathered;
+
+    static int rank_of(MPI_Comm comm) {
+        int rank;
+        MPI_Comm_rank(comm, &rank);
+        return rank;
+    }
+};
+
+#endif
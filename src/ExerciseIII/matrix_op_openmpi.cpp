@@ -84,6 +84,11 @@ int main(int argc, char* argv[]){
         MPI_Send(B.data(), sizeB, MPI_INT, 1, 11, MPI_COMM_WORLD);
         // Send A to Process 2 for transpose.
         MPI_Send(A.data(), sizeA, MPI_INT, 2, 20, MPI_COMM_WORLD);
+    } else if (rank == 1) {
+        MPI_Recv(A.data(), sizeA, MPI_INT, 0, 10, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        MPI_Recv(B.data(), sizeB, MPI_INT, 0, 11, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    } else if (rank == 2) {
+        MPI_Recv(A.data(), sizeA, MPI_INT, 0, 20, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
     }
     
     // Containers for results.